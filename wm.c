@@ -13,6 +13,7 @@ LeaveNotify       The pointer has left a window
 MotionNotify      A pointer's motion occurrs within a window
 ConfigureRequest  Request to change a window's attributes
 MapRequest        Show window on screen
+ConfigureNotify   A window's geometry has changed
 DestroyNotify     Kill the window
 
 Mask        | Value | Key
@@ -29,19 +30,59 @@ Mod5Mask    |   128 | ???
 */
 
 
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <signal.h>
+#include <time.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <spawn.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
 #include <X11/Xlib.h>
+#include <X11/Xlibint.h>
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
 #include <X11/XF86keysym.h>
 #include <X11/keysym.h>
 #include <X11/XKBlib.h>
 
 
 #define DEBUG
+// #define BENCHMARK // Run the microbenchmarks instead of the window manager
+// #define XCB       // Pipeline round trips as XCB cookies, link with -lX11-xcb -lxcb
+// #define CONTAINERS // Reparent clients into a container window per workspace
+// #define RANDR     // Follow the monitors through RandR, link with -lXrandr
+// #define OVERVIEW  // Workspace thumbnails, link with -lXcomposite -lXdamage -lXrender
+
+
+#ifdef XCB
+	#include <X11/Xlib-xcb.h>
+	#include <xcb/xcb.h>
+#endif
+
+#ifdef RANDR
+	#include <X11/extensions/Xrandr.h>
+#endif
+
+#ifdef OVERVIEW
+	#include <X11/extensions/Xcomposite.h>
+	#include <X11/extensions/Xdamage.h>
+	#include <X11/extensions/Xrender.h>
+#endif
 
 
 #define MAX( x, y )  (            \
@@ -69,21 +110,6 @@ Mod5Mask    |   128 | ???
 )
 
 
-#define window_size( window, x, y, w, h )  ( \
-	XGetGeometry(                                  \
-		display,                                   \
-		window,                                    \
-		&(Window){0},                              \
-		x,                                         \
-		y,                                         \
-		w,                                         \
-		h,                                         \
-		&(unsigned int){0},                        \
-		&(unsigned int){0}                         \
-	)                                              \
-)                                                  \
-
-
 #define SNAP
 #ifdef SNAP 
 	#define SNAP_PIXELS 20 
@@ -94,10 +120,66 @@ Mod5Mask    |   128 | ???
 	#endif
 #endif
 
+#ifdef GAPS
+	#define GAP GAP_PIXELS
+#else
+	#define GAP 0
+#endif
+
 #define BORDER 1
 
+#define DRAG_INTERVAL 16 // Minimum milliseconds between drag configures
+// #define OUTLINE         // Resize as an outline, configuring the window once on release
+
+#define TIMER_TICK  4  // Milliseconds covered by each slot of the timer wheel
+#define TIMER_SLOTS 64
+
+#define MAX_WATCHES 16 // File descriptors the main loop can wait on
+
+// Control socket, formatted with the display name. Comment out to disable
+#define CONTROL_SOCKET "wm%s.sock" // Under $XDG_RUNTIME_DIR
+#define CONTROL_BUFFER 4096
+
+// Configuration file under $HOME, reloaded as it changes. Comment out to disable
+#define CONFIG       ".config/wm/config"
+#define CONFIG_ARENA 16384 // Bytes for the commands a configuration runs
+#define CONFIG_DELAY 50    // Milliseconds the file must stay unchanged before a reload
+#define MAX_KEYS     255   // Key bindings, defaults included, indexed by a byte
+#define RULE_BUCKETS 64    // Buckets of the window rule table, a power of two
+
+#define TRACE_SIZE 4096 // Events kept in the trace ring, a power of two
+
+#define POOL_SLAB 64 // Clients allocated together as the pool runs dry
+
+#define IGNORE_RANGES 16 // Recent request ranges whose crossing events are dropped
+
+#define MAX_BATCH 256 // Configures and raises held until the end of a batch
+#define MAX_STATES 8  // _NET_WM_STATE atoms of its own a client keeps
+
+#define MAX_PROCESSES 64    // Children tracked until they exit
+#define PATH_CACHE    32    // Commands whose $PATH lookup is remembered
+#define SPAWN_TIMEOUT 10000 // Milliseconds a child may take to map a window
+
+#define SNAPSHOT_MAGIC 0x32534d57 // "WMS2", bumped as the snapshot layout changes
+
 #define MINIMUM_SIZE 50
 
+#define LAYOUT LAYOUT_MASTER // Layout of every workspace at startup
+
+#define MAX_OUTPUTS LENGTH( workspaces ) // Every output shows a workspace
+
+#define OVERVIEW_SCALE 3 // Thumbnails are a third of their output, a 3x3 grid
+
+// The output rectangle of a workspace, and the origin its windows are
+// positioned from
+#define AREA( i ) ( outputs[monitors[( i )]].r )
+
+#ifdef CONTAINERS
+	#define PARENT( i ) AREA( i )
+#else
+	#define PARENT( i ) ( ( rect_t ) { 0, 0, 0, 0 } )
+#endif
+
 
 // Mask        | Value | Key
 // ------------+-------+------------
@@ -118,6 +200,13 @@ Mod5Mask    |   128 | ???
 	( ShiftMask | ControlMask | Mod1Mask | Mod4Mask | Mod5Mask ) \
 )
 
+// Pack the five bits left by CLEAN_MASK into an index below 32
+#define MASK_INDEX(mask) (                    \
+	( CLEAN_MASK( mask ) & ShiftMask ) |      \
+	( CLEAN_MASK( mask ) >> 1 & 0x06 ) |      \
+	( CLEAN_MASK( mask ) >> 3 & 0x18 )        \
+)
+
 
 ///////////////////////////////////////////////////////////////////////
 // TYPES
@@ -131,6 +220,95 @@ typedef union
 } argument_t;
 
 
+// A timer armed through timeout_add(), owned by the caller so that arming
+// never allocates. next and prev chain the timers sharing a wheel slot
+
+typedef struct timeout_t
+{
+	struct timeout_t *next, *prev;
+	uint64_t deadline;
+	uint8_t pending;
+	void ( *f )( argument_t const a );
+	argument_t a;
+} timeout_t;
+
+
+// A file descriptor the main loop waits on, f is called once it is readable
+
+typedef struct
+{
+	int fd;
+	void ( *f )( int );
+} watch_t;
+
+
+// The handlers timed by handle_event(), indexing HANDLERS and histograms
+
+typedef enum
+{
+	HANDLER_POINTER,
+	HANDLER_KEY,
+	HANDLER_MAP_REQUEST,
+	HANDLER_DESTROY_NOTIFY,
+	HANDLER_UNMAP_NOTIFY,
+	HANDLER_ENTER_NOTIFY,
+	HANDLER_CONFIGURE_REQUEST,
+	HANDLER_CONFIGURE_NOTIFY,
+	HANDLER_MAPPING_NOTIFY,
+	HANDLER_SCREEN_CHANGE,
+	HANDLER_CLIENT_MESSAGE,
+	HANDLER_DAMAGE_NOTIFY,
+	HANDLER_EXPOSE,
+	HANDLER_PROPERTY_NOTIFY,
+	HANDLER_COUNT
+} handler_t;
+
+
+// An entry of the trace ring, time is the monotonic time the handler started
+
+typedef struct
+{
+	uint64_t time;
+	uint32_t duration;
+	uint8_t type;
+	uint8_t handler;
+	Window window;
+} trace_t;
+
+
+// A log-linear latency histogram in nanoseconds. Values below 16 land in
+// bucket 0, every other power of two is split into 16 linear sub-buckets,
+// bounding the error of any reported percentile to 1/16
+
+typedef struct
+{
+	uint64_t count, max;
+	uint32_t buckets[61][16];
+} histogram_t;
+
+
+// A connection to the control socket. Commands are newline terminated and
+// buffered until complete, so a batch may arrive over several reads
+
+typedef struct
+{
+	int fd;
+	uint32_t length;
+	char buffer[CONTROL_BUFFER];
+} control_t;
+
+
+// A control socket command, reply writes the outcome of f into the reply
+// buffer. Commands with a reply of NULL answer "ok"
+
+typedef struct
+{
+	char const *name;
+	void ( *f )( argument_t const a );
+	int ( *reply )( char *, size_t, argument_t const );
+} command_t;
+
+
 typedef struct 
 {
     unsigned int mod;
@@ -140,10 +318,329 @@ typedef struct
 } key_input_t;
 
 
+// An action a configuration file can bind a key to
+
+typedef struct
+{
+	char const *name;
+	void ( *f )( argument_t const a );
+} action_t;
+
+
+// What a window rule matches on, in order of precedence
+
+typedef struct
+{
+	int32_t x, y;
+	uint32_t w, h;
+} rect_t;
+
+
+typedef enum
+{
+	RULE_TITLE,
+	RULE_INSTANCE,
+	RULE_CLASS,
+	RULE_COUNT
+} rule_field_t;
+
+
+// A window rule, applied as a window first maps. workspace and floating are
+// -1 where the rule leaves them be, geometry is relative to the output and
+// applies when w is set. Rules sharing a bucket are chained through next
+
+typedef struct rule_t
+{
+	struct rule_t *next;
+	uint32_t hash;
+	uint8_t field;
+	char const *value;
+	int8_t workspace, floating;
+	uint8_t focus;
+	rect_t geometry;
+} rule_t;
+
+
+// The settings a configuration file can change, starting from the constants.
+// keys holds the bindings of the file ahead of KEYS, so that the file wins
+// where both bind a key. rules is a hash table of the window rules keyed by
+// field and value, rule_fields the set of fields some rule matches on. The
+// rules, and the commands run by the bindings, terminal and menu, are
+// allocated from arena, freeing the configuration frees them all
+
+typedef struct
+{
+	uint32_t border, snap, gap, mod;
+	uint32_t key_count;
+	key_input_t keys[MAX_KEYS];
+	char const **terminal, **menu;
+	rule_t *rules[RULE_BUCKETS];
+	uint8_t rule_fields;
+	uint32_t used;
+	char arena[CONFIG_ARENA];
+} config_t;
+
+
+// Which half of the screen a window is tiled to on each axis, -1 for the
+// left or top, 1 for the right or bottom and 0 for the full length
+
+typedef struct
+{
+	int8_t x, y;
+} tile_t;
+
+
+// The size constraints of a window's WM_NORMAL_HINTS, 0 where unset. Per
+// ICCCM the base and minimum sizes each stand in for the other when only one
+// is given
+
+typedef struct
+{
+	uint32_t min_w, min_h, max_w, max_h;
+	uint32_t base_w, base_h, inc_w, inc_h;
+} hints_t;
+
+
+// Automatic layouts of a workspace. Floating leaves placement to the user,
+// master gives the first window the left half and stacks the rest on the
+// right, bsp halves the remaining space for every window in turn
+
+typedef enum
+{
+	LAYOUT_FLOATING,
+	LAYOUT_MASTER,
+	LAYOUT_BSP,
+	LAYOUT_COUNT
+} layout_t;
+
+
+// Atoms interned together by ewmh_setup(), indexing ATOMS and atoms. Those
+// from NET_SUPPORTED to NET_WM_STATE_FULLSCREEN are advertised in
+// _NET_SUPPORTED
+
+typedef enum
+{
+	NET_SUPPORTED,
+	NET_SUPPORTING_WM_CHECK,
+	NET_WM_NAME,
+	NET_NUMBER_OF_DESKTOPS,
+	NET_CURRENT_DESKTOP,
+	NET_ACTIVE_WINDOW,
+	NET_CLIENT_LIST,
+	NET_WM_DESKTOP,
+	NET_WM_STATE,
+	NET_WM_STATE_FULLSCREEN,
+	NET_WM_PID,
+	WM_STATE,
+	UTF8_STRING,
+	ATOM_COUNT
+} atom_t;
+
+
+// The serials of a run of requests the window manager made, inclusive
+
+typedef struct
+{
+	unsigned long from, to;
+} serials_t;
+
+
+// A child of the window manager, kept from its spawn until it is reaped.
+// mapped is set once a window has been matched to it, start is monotonic()
+// at the spawn
+
+typedef struct
+{
+	pid_t pid;
+	uint8_t mapped;
+	uint64_t start;
+	char name[32];
+} process_t;
+
+
+// A command and the file $PATH resolved it to
+
+typedef struct
+{
+	char *name, *path;
+} path_t;
+
+
+// The state handed from a restarting window manager to its successor through
+// a memfd, a snapshot_t followed by count snapshot_client_t in the focus
+// order of each workspace. Only one binary reads what it wrote, so the
+// layout is native
+
+typedef struct
+{
+	uint32_t magic, count, orders;
+	uint64_t time;
+	uint8_t workspace;
+	uint8_t layouts[9], monitors[9], shown[9];
+	Window containers[9];
+} snapshot_t;
+
+typedef struct
+{
+	Window window;
+	int32_t x, y;
+	uint32_t w, h, border, order;
+	uint8_t workspace, floating, fullscreen;
+} snapshot_client_t;
+
+
+// A monitor, identified by its RandR output, and the workspace it shows.
+// Every workspace belongs to one output, so each output has a set of
+// workspaces of its own
+
+typedef struct
+{
+	XID id;
+	rect_t r;
+	uint8_t workspace;
+} output_t;
+
+
+// The rows of an output within a slab of the screen, from top to just above
+// bottom. Spans of one slab never overlap, an output overlapping another
+// only keeps the rows the other leaves
+
+typedef struct
+{
+	int32_t top, bottom;
+	uint8_t output;
+} span_t;
+
+
+#ifdef OVERVIEW
+
+// The thumbnail of a workspace as it was last shown, w and h wide and high.
+// dirty is set as the windows of the workspace are damaged, moved, stacked,
+// added or removed, and cleared once the thumbnail is rendered again
+
+typedef struct
+{
+	Pixmap pixmap;
+	Picture picture;
+	uint32_t w, h;
+	uint8_t dirty;
+} thumbnail_t;
+
+#endif
+
+
+// An interactive move or resize from ButtonPress to ButtonRelease. x, y, w
+// and h are the window's geometry at the press, px and py the last pointer
+// position, pending set while that position is not yet applied
+
+typedef struct
+{
+	XButtonEvent mouse;
+	int32_t x, y, w, h;
+	int32_t px, py;
+	Time last;
+	uint8_t pending;
+	uint32_t motions, configures;
+	timeout_t timeout;
+} drag_t;
+
+
+// A child of the root found at startup, or a window restored from a
+// snapshot, as its replies describe it. replies holds the ADOPT_ flags of the
+// replies received, mapped is also set for a window mapped in an unmapped
+// container, desktop is ~0 without a _NET_WM_DESKTOP
+
+enum
+{
+	ADOPT_ATTRIBUTES = 1,
+	ADOPT_GEOMETRY   = 2,
+	ADOPT_QUERIES    = 4 // Requests per window, in order attributes, geometry,
+	                     // WM_STATE and _NET_WM_DESKTOP
+};
+
+typedef struct
+{
+	Window window;
+	uint8_t replies;
+	uint8_t viewable, mapped, override, iconic;
+	rect_t r;
+	uint32_t desktop;
+} adoptee_t;
+
+
+// The windows whose queries an Xlib async handler is answering, from the
+// sequence number of the first query
+
+typedef struct
+{
+	unsigned long first;
+	uint32_t n;
+	adoptee_t *windows;
+} adoption_t;
+
+
+// The per-client EWMH properties waiting for the next flush, and whether the
+// _NET_WM_STATE atoms the client set itself have been read
+
+enum
+{
+	EWMH_DESKTOP = 1,
+	EWMH_STATE   = 2,
+	EWMH_READ    = 4
+};
+
+
+// Each workspace is a circular doubly linked ring of clients whose head is the
+// focused client, next walks toward the least recently focused. link chains
+// the clients sharing a bucket of the window index.
+//
+// x, y, w, h and border hold the geometry the window manager last requested
+// for the window, kept in sync with the server through ConfigureNotify so
+// that geometry reads never need a round trip. tile is the layout of that
+// geometry, derived once as the window is placed.
+//
+// order places the client among the tiled windows of its workspace, lowest
+// first, independent of focus so that focusing never moves a window.
+// floating clients are left out of the automatic layout.
+//
+// fullscreen is set while the window holds the geometry window_fullscreen()
+// gave it, until it is next moved or resized.
+//
+// hints caches the WM_NORMAL_HINTS of the window, read as it is first resized
+// and again after the client changes them, while hinted is set.
+//
+// unmaps counts the UnmapNotify events the window manager caused itself and
+// still expects, any other unmap is the client withdrawing the window. Free
+// clients are chained through next in the pool.
+//
+// With OVERVIEW, damage reports the first change to the window since its
+// workspace's thumbnail was rendered, picture is the scaled source the
+// thumbnail is rendered from
+
 typedef struct client_t
 {
-	struct client_t *next;
+	struct client_t *next, *prev;
+	struct client_t *link;
 	Window window;
+	uint8_t workspace;
+	int32_t x, y;
+	uint32_t w, h, border;
+	tile_t tile;
+	uint32_t order;
+	uint8_t floating;
+	uint8_t fullscreen;
+	uint8_t unmaps;
+	hints_t hints;
+	uint8_t hinted;
+	uint8_t configure;
+	uint32_t raise;
+	uint8_t ewmh;
+	uint8_t state_count;
+	Atom states[MAX_STATES];
+#ifdef OVERVIEW
+	Damage damage;
+	Picture picture;
+#endif
 } client_t;
 
 
@@ -154,27 +651,172 @@ typedef struct client_t
 
 void handle_event( XEvent * );
 void pointer_event( XEvent * );
+void drag_apply( client_t *, uint8_t );
+void drag_timeout( argument_t const );
+void drag_end();
 void configure_request( XEvent * );
+void configure_notify( XEvent * );
 void destroy_notify( XEvent * );
+void unmap_notify( XEvent * );
+void crossing_ignore( unsigned long );
 void enter_notify( XEvent * );
 void key_event( XEvent * );
 void map_request( XEvent * );
-void window_add( Window );
+void mapping_notify( XEvent * );
+void client_message( XEvent * );
+void property_notify( XEvent * );
+client_t *window_add( Window, uint8_t );
+void window_adopt();
+uint32_t adopt_query( adoptee_t ** );
+uint32_t adopt_managed( Window * );
+#ifndef XCB
+Bool adopt_reply( Display *, xReply *, char *, int, XPointer );
+#endif
+void window_state( Window, long );
 void window_delete( Window );
+client_t *window_find( Window );
+void client_link( client_t *, uint8_t );
+void client_unlink( client_t * );
+void client_index( client_t * );
+void client_unindex( client_t * );
+client_t *client_alloc();
+void client_free( client_t * );
+void window_move_resize( client_t *, rect_t );
+void window_check( client_t * );
+void window_hints( client_t * );
 void window_kill( argument_t const );
 void window_current( Window );
+void focus_request( Window );
+void focus_flush();
+void window_configure( client_t *, uint8_t );
+void batch_configure( client_t * );
+void batch_raise( client_t * );
+void batch_stack();
+void batch_flush( uint32_t );
 void window_center( Window );
 void window_fullscreen( argument_t const );
+void client_fullscreen( client_t *, uint8_t );
 void window_next( argument_t const );
 void window_previous( argument_t const );
-void window_snap( int xf, int yf, int *x, int *y, int *w, int *h );
 void window_push( argument_t const a );
 void window_to_workspace( argument_t const );
+void window_send( client_t *, uint8_t );
+void window_float( argument_t const );
+void window_swap( argument_t const );
+void workspace_layout( argument_t const );
+void workspace_tile( uint8_t );
+void workspace_show( uint8_t, uint8_t );
+void output_update();
+void output_index();
+uint8_t output_at( int32_t, int32_t );
+#ifdef RANDR
+void screen_change( XEvent * );
+#endif
+#ifdef OUTLINE
+void outline_setup();
+void outline_draw( rect_t, uint8_t );
+#endif
+#ifdef OVERVIEW
+void overview( argument_t const );
+void overview_close();
+void overview_draw();
+void overview_select( int32_t, int32_t );
+void thumbnail_render( uint8_t );
+void thumbnail_watch( client_t * );
+void thumbnail_forget( client_t * );
+void damage_notify( XEvent * );
+#endif
+rect_t layout_snap( rect_t, uint32_t, tile_t );
+tile_t layout_tile( rect_t, rect_t );
+tile_t layout_push( tile_t, uint8_t );
+int layout_edge( rect_t, int32_t, int32_t, uint32_t, tile_t * );
+rect_t layout_move( rect_t, rect_t, int32_t, int32_t );
+rect_t layout_resize( rect_t, rect_t, int32_t, int32_t, uint32_t );
+rect_t layout_center( rect_t, uint32_t, uint32_t );
+rect_t layout_hints( rect_t, hints_t const * );
+void layout_tiles( layout_t, rect_t, uint32_t, uint32_t, rect_t * );
 void to_workspace( argument_t const );
 void run( argument_t const );
+char const *process_path( char const *, uint8_t );
+void process_add( pid_t, char const * );
+void process_reap();
+void process_mapped( Window );
 void quit( argument_t const );
+void restart( argument_t const );
+#ifdef CONTAINERS
+void restart_release();
+void restart_reclaim();
+#endif
+int snapshot_open( snapshot_t * );
+void snapshot_restore( int, snapshot_t const * );
+void config_init( config_t * );
+char const *config_finish( config_t * );
+uint32_t rule_hash( uint8_t, char const * );
+rule_t const *rule_find( Window );
+#ifdef CONFIG
+config_t *config_read();
+char const *config_line( config_t *, char * );
+void config_apply( config_t * );
+void config_open();
+void config_event( int );
+void config_reload( argument_t const );
+#endif
+void ewmh_setup();
+void ewmh_flush();
+void ewmh_client_add( Window );
+void ewmh_client_remove( Window );
+void ewmh_desktop( client_t * );
+void ewmh_state( client_t * );
+void ewmh_mark( client_t *, uint8_t );
+void ewmh_client_write( client_t * );
 void grab_input();
+#ifdef XCB
+KeyCode keysym_to_keycode( xcb_get_keyboard_mapping_reply_t *, KeySym );
+#endif
+void watch_add( int, void ( * )( int ) );
+void watch_delete( int );
+void timeout_add( timeout_t *, uint32_t );
+void timeout_cancel( timeout_t * );
+void timeout_arm();
+void timer_event( int );
+void signal_event( int );
+void display_event( int );
+void event_loop();
+#ifdef CONTROL_SOCKET
+void control_open();
+void control_close();
+void control_accept( int );
+void control_read( int );
+int control_command( char *, char *, size_t );
+void control_focus( argument_t const );
+void control_geometry( argument_t const );
+int control_state( char *, size_t, argument_t const );
+int control_clients( char *, size_t, argument_t const );
+int control_outputs( char *, size_t, argument_t const );
+int control_latency( char *, size_t, argument_t const );
+int control_trace( char *, size_t, argument_t const );
+int control_processes( char *, size_t, argument_t const );
+int control_memory( char *, size_t, argument_t const );
+int control_counters( char *, size_t, argument_t const );
+int control_batches( char *, size_t, argument_t const );
+#endif
+void trace( XEvent *, handler_t, uint64_t );
+void trace_dump( FILE * );
+void histogram_add( histogram_t *, uint64_t );
+uint64_t histogram_percentile( histogram_t const *, double );
 static int xerror();
+uint64_t monotonic();
+void setup();
+#ifdef BENCHMARK
+int benchmark();
+void benchmark_clients();
+void benchmark_spawn();
+int benchmark_layout();
+int benchmark_display();
+pid_t benchmark_xvfb( char *, size_t );
+int benchmark_wait( Display *, Window, int );
+void benchmark_report( char const *, histogram_t const * );
+#endif
 
 
 ///////////////////////////////////////////////////////////////////////
@@ -183,19 +825,180 @@ static int xerror();
 
 
 static uint8_t  loop;
+static char     **arguments;
 static Display  *display;
+#ifdef XCB
+static xcb_connection_t *connection;
+#endif
 static Window   root;
 static client_t *workspaces[9] = {0};
 static uint8_t  workspace = 0;
+static layout_t layouts[LENGTH( workspaces )];
+static uint32_t orders;
+
+// Outputs sorted by x then y, and the output of every workspace
+static output_t outputs[MAX_OUTPUTS];
+static uint8_t  output_count;
+static uint8_t  monitors[LENGTH( workspaces )];
+
+// The screen cut into vertical slabs at every left and right edge of an
+// output, each with the spans of the outputs crossing it sorted by y, so
+// that output_at() is a binary search for the slab then one for the span
+static int32_t  slab_edges[MAX_OUTPUTS * 2];
+static uint8_t  edge_count;
+static span_t   slabs[MAX_OUTPUTS * 2][MAX_OUTPUTS];
+static uint8_t  span_counts[MAX_OUTPUTS * 2];
+#ifdef RANDR
+static int      randr_event;
+#endif
+#ifdef CONTAINERS
+static Window   containers[LENGTH( workspaces )];
+#endif
+#ifdef OVERVIEW
+static int      damage_event;
+static Window   overview_window;
+static Picture  overview_picture;
+static rect_t   overview_area;
+static thumbnail_t thumbnails[LENGTH( workspaces )];
+static uint64_t damages, thumbnails_rendered;
+#endif
+static client_t **clients;
+static uint32_t client_count, client_buckets;
+
+// Free clients, and the lifetime counts of clients managed and removed. A
+// destroyed window is unmapped first, so a removal is counted once whichever
+// notify comes first
+static client_t *pool;
+static uint32_t pool_idle, pool_slabs;
+static uint64_t created, removed;
+
+// ConfigureRequests passed on to the server, and those answered with a
+// synthetic ConfigureNotify instead
+static uint64_t configures_forwarded, configures_refused;
+
+// Requests whose crossing events are the window manager's own, and the
+// focus to be set at the end of the event batch
+static serials_t ignores[IGNORE_RANGES];
+static uint32_t ignore_head;
+static Window   focus_pending;
+static uint64_t crossings_ignored, focus_requests, focus_sets;
+
+// The drag in progress, and the lifetime counts of drags, the motions they
+// received and the configures they sent
+static drag_t   drag = { .timeout = { .f = drag_timeout } };
+static uint64_t drags, drag_motions, drag_configures;
+static uint64_t rules_matched;
+
+// Windows whose geometry or stacking changed during the batch, by window as
+// a client may be freed mid-batch. A raise entry is live while its client's
+// raise is its index + 1, so that a window raised twice is raised once, in
+// the place of its last raise
+static Window   configure_queue[MAX_BATCH], raise_queue[MAX_BATCH];
+static uint32_t configure_count, raise_count;
+static uint32_t batch_queued, batch_sent;
+static uint64_t batches, requests_queued, requests_sent;
+static histogram_t batch_events, batch_coalesced;
 static int32_t sw, sh;
 static uint32_t NumLockMask = 0; 
 
+// The configuration in use, the built in one until a file is read
+static config_t *config;
+static config_t defaults;
+#ifdef CONFIG
+static char     config_path[PATH_MAX];
+static int      config_fd = -1;
+static timeout_t config_timeout = { .f = config_reload };
+#endif
+#ifdef OUTLINE
+static GC       outline_gc;
+#endif
+
+// Index + 1 into KEYS for every keycode and MASK_INDEX, and the bitset of
+// modifier masks currently grabbed for every keycode
+static uint8_t  bindings[256][32];
+static uint8_t  grabs[256][256 / 8];
+
+static int      epoll_fd, timer_fd, signal_fd;
+static watch_t  watches[MAX_WATCHES];
+static timeout_t *wheel[TIMER_SLOTS];
+static uint64_t wheel_tick;
+
+// Written only by the event loop and read only on request, an entry costs a
+// store and a histogram increment
+static trace_t  traces[TRACE_SIZE];
+static uint32_t trace_head;
+static histogram_t histograms[HANDLER_COUNT];
+
+static process_t processes[MAX_PROCESSES];
+static path_t    paths[PATH_CACHE];
+static uint32_t  path_next;
+static histogram_t spawns; // Spawn to MapRequest of the child's first window
+
+// _NET_CLIENT_LIST in mapping order, and how much of it the root holds. Once
+// a window leaves the list, the property is stale and rewritten whole
+static Atom     atoms[ATOM_COUNT];
+static Window   check;
+static Window   *client_list;
+static uint32_t client_list_length, client_list_size, client_list_written;
+static uint8_t  client_list_stale;
+
+// Clients whose _NET_WM_DESKTOP or _NET_WM_STATE changed since the last flush
+static Window   ewmh_queue[MAX_BATCH];
+static uint32_t ewmh_count;
+
+// The focused window and workspace last written to the root
+static Window   active_window, active_written;
+static uint8_t  desktop_written;
+static uint64_t property_writes;
+
+static char *ATOMS[] = {
+	[NET_SUPPORTED]           = "_NET_SUPPORTED",
+	[NET_SUPPORTING_WM_CHECK] = "_NET_SUPPORTING_WM_CHECK",
+	[NET_WM_NAME]             = "_NET_WM_NAME",
+	[NET_NUMBER_OF_DESKTOPS]  = "_NET_NUMBER_OF_DESKTOPS",
+	[NET_CURRENT_DESKTOP]     = "_NET_CURRENT_DESKTOP",
+	[NET_ACTIVE_WINDOW]       = "_NET_ACTIVE_WINDOW",
+	[NET_CLIENT_LIST]         = "_NET_CLIENT_LIST",
+	[NET_WM_DESKTOP]          = "_NET_WM_DESKTOP",
+	[NET_WM_STATE]            = "_NET_WM_STATE",
+	[NET_WM_STATE_FULLSCREEN] = "_NET_WM_STATE_FULLSCREEN",
+	[NET_WM_PID]              = "_NET_WM_PID",
+	[WM_STATE]                = "WM_STATE",
+	[UTF8_STRING]             = "UTF8_STRING",
+};
+
+static char const *HANDLERS[] = {
+	[HANDLER_POINTER]           = "pointer",
+	[HANDLER_KEY]               = "key",
+	[HANDLER_MAP_REQUEST]       = "map_request",
+	[HANDLER_DESTROY_NOTIFY]    = "destroy_notify",
+	[HANDLER_UNMAP_NOTIFY]      = "unmap_notify",
+	[HANDLER_ENTER_NOTIFY]      = "enter_notify",
+	[HANDLER_CONFIGURE_REQUEST] = "configure_request",
+	[HANDLER_CONFIGURE_NOTIFY]  = "configure_notify",
+	[HANDLER_MAPPING_NOTIFY]    = "mapping_notify",
+	[HANDLER_SCREEN_CHANGE]     = "screen_change",
+	[HANDLER_CLIENT_MESSAGE]    = "client_message",
+	[HANDLER_DAMAGE_NOTIFY]     = "damage_notify",
+	[HANDLER_EXPOSE]            = "expose",
+	[HANDLER_PROPERTY_NOTIFY]   = "property_notify",
+};
+
+#ifdef CONTROL_SOCKET
+static int      control_fd = -1;
+static char     control_path[108];
+static control_t controls[MAX_WATCHES];
+#endif
+
+// NULL terminated even when empty, so that the two are told apart by address
 static char const *terminal[] = {
-//    "st", NULL 
+//    "st", 
+	NULL 
 };
 
 static char const *menu[] = { 
-//    "dmenu_run", NULL 
+//    "dmenu_run", 
+	NULL 
 };
 
 key_input_t const KEYS[] = {
@@ -204,11 +1007,21 @@ key_input_t const KEYS[] = {
 	{ MOD,           XK_Return, run,                 { .p = terminal } },
 	{ MOD,           XK_d,      run,                 { .p = menu } },
 	{ MOD|ShiftMask, XK_q,      quit,                { 0 } },
+	{ MOD|ShiftMask, XK_r,      restart,             { 0 } },
 
 	{ MOD,           XK_Tab,    window_next,         { 0 } },
 	{ MOD|ShiftMask, XK_Tab,    window_previous,     { 0 } },
 	{ MOD,           XK_f,      window_fullscreen,   { 0 } },
 	{ MOD,           XK_q,      window_kill,         { 0 } },
+	{ MOD,           XK_space,  window_float,        { 0 } },
+	{ MOD|ShiftMask, XK_Return, window_swap,         { 0 } },
+#ifdef OVERVIEW
+	{ MOD,           XK_o,      overview,            { 0 } },
+#endif
+
+	{ MOD,           XK_t,      workspace_layout,    { .x = LAYOUT_MASTER } },
+	{ MOD,           XK_b,      workspace_layout,    { .x = LAYOUT_BSP } },
+	{ MOD|ShiftMask, XK_f,      workspace_layout,    { .x = LAYOUT_FLOATING } },
 
 	{ MOD,           XK_h,      window_push,         { .x = 2 } },
 	{ MOD,           XK_j,      window_push,         { .x = 3 } },
@@ -243,6 +1056,74 @@ key_input_t const KEYS[] = {
 //	{ 0, XF86XK_MonBrightnessDown, run,              { .p = bridown } },
 };
 
+#ifdef CONFIG
+// Actions take at most one numeric argument, except run which takes the rest
+// of the line as its command
+action_t const ACTIONS[] = {
+	{ "run",         run },
+	{ "quit",        quit },
+	{ "restart",     restart },
+	{ "reload",      config_reload },
+
+	{ "next",        window_next },
+	{ "previous",    window_previous },
+	{ "fullscreen",  window_fullscreen },
+	{ "kill",        window_kill },
+	{ "push",        window_push },
+	{ "float",       window_float },
+	{ "swap",        window_swap },
+	{ "layout",      workspace_layout },
+
+	{ "workspace",   to_workspace },
+	{ "send",        window_to_workspace },
+#ifdef OVERVIEW
+	{ "overview",    overview },
+#endif
+};
+#endif
+
+#ifdef CONTROL_SOCKET
+// Commands take at most one numeric argument, except run which takes the
+// rest of the line as its command and geometry which takes x y w h
+command_t const COMMANDS[] = {
+//	{ "name",        f(),                 reply() },
+
+	{ "run",         run,                 NULL },
+	{ "quit",        quit,                NULL },
+	{ "restart",     restart,             NULL },
+#ifdef CONFIG
+	{ "reload",      config_reload,       NULL },
+#endif
+
+	{ "next",        window_next,         NULL },
+	{ "previous",    window_previous,     NULL },
+	{ "fullscreen",  window_fullscreen,   NULL },
+	{ "kill",        window_kill,         NULL },
+	{ "push",        window_push,         NULL },
+	{ "focus",       control_focus,       NULL },
+	{ "geometry",    control_geometry,    NULL },
+	{ "float",       window_float,        NULL },
+	{ "swap",        window_swap,         NULL },
+	{ "layout",      workspace_layout,    NULL },
+
+	{ "workspace",   to_workspace,        NULL },
+#ifdef OVERVIEW
+	{ "overview",    overview,            NULL },
+#endif
+	{ "send",        window_to_workspace, NULL },
+
+	{ "state",       NULL,                control_state },
+	{ "clients",     NULL,                control_clients },
+	{ "outputs",     NULL,                control_outputs },
+	{ "latency",     NULL,                control_latency },
+	{ "trace",       NULL,                control_trace },
+	{ "processes",   NULL,                control_processes },
+	{ "memory",      NULL,                control_memory },
+	{ "counters",    NULL,                control_counters },
+	{ "batches",     NULL,                control_batches },
+};
+#endif
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // EVENT
@@ -251,167 +1132,392 @@ key_input_t const KEYS[] = {
 
 // handle_event()
 //
-// Handle a the given XEvent
+// Handle a the given XEvent, tracing it and timing its handler
 //
 // e - The current XEvent
 
 void handle_event( XEvent *e )
 {
+	uint64_t start = monotonic();
+	unsigned long serial = NextRequest( display );
+	handler_t handler;
+
 	switch( e->type )
 	{
 		case ButtonPress:
 		case ButtonRelease:
 	 	case MotionNotify:
 			pointer_event( e );
+			handler = HANDLER_POINTER;
 			break;
 
 	 	case KeyPress:         
 		case KeyRelease:
 			key_event( e );
+			handler = HANDLER_KEY;
 			break;
 
 	 	case MapRequest:
 			map_request( e );
+			handler = HANDLER_MAP_REQUEST;
 			break;
 
 	 	case DestroyNotify:
 			destroy_notify( e );
+			handler = HANDLER_DESTROY_NOTIFY;
+			break;
+
+	 	case UnmapNotify:
+			unmap_notify( e );
+			handler = HANDLER_UNMAP_NOTIFY;
 			break;
 
 	 	case EnterNotify:
 			enter_notify( e );
+			handler = HANDLER_ENTER_NOTIFY;
 			break;
 
 	 	case ConfigureRequest:
 			configure_request( e );
+			handler = HANDLER_CONFIGURE_REQUEST;
+			break;
+
+	 	case ConfigureNotify:
+			configure_notify( e );
+			handler = HANDLER_CONFIGURE_NOTIFY;
+			break;
+
+	 	case MappingNotify:
+			mapping_notify( e );
+			handler = HANDLER_MAPPING_NOTIFY;
+			break;
+
+	 	case ClientMessage:
+			client_message( e );
+			handler = HANDLER_CLIENT_MESSAGE;
+			break;
+
+	 	case PropertyNotify:
+			property_notify( e );
+			handler = HANDLER_PROPERTY_NOTIFY;
 			break;
+
+	#ifdef OVERVIEW
+	 	case Expose:
+			if( e->xexpose.window == overview_window && !e->xexpose.count )
+				overview_draw();
+			handler = HANDLER_EXPOSE;
+			break;
+	#endif
+
+		default:
+		#ifdef RANDR
+			if( e->type == randr_event + RRScreenChangeNotify )
+			{
+				screen_change( e );
+				handler = HANDLER_SCREEN_CHANGE;
+				break;
+			}
+		#endif
+		#ifdef OVERVIEW
+			if( e->type == damage_event + XDamageNotify )
+			{
+				damage_notify( e );
+				handler = HANDLER_DAMAGE_NOTIFY;
+				break;
+			}
+		#endif
+			return;
 	}
+
+	crossing_ignore( serial );
+	trace( e, handler, start );
 }
 
 
 // pointer_event()
 //
-// Respond to mouse events
+// Respond to mouse events. Drags are grabbed with PointerMotionHintMask so
+// that at most one MotionNotify is queued at a time, and the window is
+// configured at most once every DRAG_INTERVAL milliseconds. A motion held
+// back by the interval is applied by a timer should no other motion follow,
+// and the last position is always applied on ButtonRelease
 //
 // e - The given XEvent
 
 void pointer_event( XEvent *e )
 {
-	static XButtonEvent mouse;	
-	static int32_t  x, y, w, h;
-
-	if( e->type == MotionNotify && mouse.subwindow )
+#ifdef OVERVIEW
+	if( e->type == ButtonPress && e->xbutton.window == overview_window )
 	{
-		#ifdef DEBUG
-			fputs( "MOTION NOTIFY\n", stderr );
-		#endif
-
-    	while( XCheckTypedEvent( display, MotionNotify, e ) );
-
-	#ifdef SNAP
+		overview_select( e->xbutton.x, e->xbutton.y );
+		return;
+	}
+#endif
 
-		int32_t nx, ny, nw, nh;
-		nx = e->xbutton.x_root;
-		ny = e->xbutton.y_root;
-	
-		if( mouse.button == 1 )
-		{	
-			if( SNAP_PIXELS < nx && nx < sw - SNAP_PIXELS &&
-			    SNAP_PIXELS < ny && ny < sh - SNAP_PIXELS )
-			{
-		        nx = BETWEEN( x + nx - mouse.x_root, 0, sw - w );
-		        ny = BETWEEN( y + ny - mouse.y_root, 0, sh - h );
-		        nw = w;
-				nh = h;
-			}
-			else
-			{
-				int32_t xf = 0, yf = 0;
+	// Looked up on every event rather than kept, as the window may be
+	// destroyed or withdrawn mid-drag and its client freed
+	client_t *client = drag.mouse.subwindow ? window_find( drag.mouse.subwindow ) : NULL;
 
-				if ( nx <= SNAP_PIXELS )      xf = -1;
-				if ( nx >= sw - SNAP_PIXELS ) xf = 1;
-				if ( ny <= SNAP_PIXELS )      yf = -1;
-				if ( ny >= sh - SNAP_PIXELS ) yf = 1;
+	if( e->type == MotionNotify && drag.mouse.subwindow && client )
+	{
+		drag.motions++;
 
-				window_snap( xf, yf, &nx, &ny, &nw, &nh );
-			}		
+		// Querying the pointer also rearms the motion hint
+		if( e->xmotion.is_hint )
+		{
+			if( !XQueryPointer( display, root, &(Window){0}, &(Window){0}, 
+			                    &drag.px, &drag.py, &(int){0}, &(int){0}, 
+			                    &(unsigned int){0} ) )
+				return;
 		}
-		// Resize
-		else if( mouse.button == 3 )
+		else
 		{
-		    nw = BETWEEN( w + nx - mouse.x_root, 0, sw - x );
-		    nh = BETWEEN( h + ny - mouse.y_root, 0, sh - y );
-			nx = x;
-			ny = y;
+			drag.px = e->xmotion.x_root;
+			drag.py = e->xmotion.y_root;
 		}
-		
-		XMoveResizeWindow( 
-			display, 
-			mouse.subwindow,
-			nx,
-			ny,
-			nw,
-			nh 
-		);
 
-	#else // SNAP
+		drag.pending = 1;
 
-    	int32_t dx = e->xbutton.x_root - mouse.x_root;
-    	int32_t dy = e->xbutton.y_root - mouse.y_root;
+		if( e->xmotion.time - drag.last < DRAG_INTERVAL )
+		{
+			if( !drag.timeout.pending )
+				timeout_add( &drag.timeout, DRAG_INTERVAL - ( e->xmotion.time - drag.last ) );
 
-    	XMoveResizeWindow(
-			display, 
-			mouse.subwindow,
-    	    BETWEEN( x + ( mouse.button == 1 ? dx : 0 ), 0, sw - w ),
-    	    BETWEEN( y + ( mouse.button == 1 ? dy : 0 ), 0, sh - h ),
-    	    BETWEEN( w + ( mouse.button == 3 ? dx : 0), MINIMUM_SIZE, sw - x ),
-    	    BETWEEN( h + ( mouse.button == 3 ? dy : 0), MINIMUM_SIZE, sh - y )
-		);
+			return;
+		}
 
-	#endif // SNAP
+		drag.last = e->xmotion.time;
+		drag_apply( client, 0 );
 	}
 	else if( e->type == ButtonPress )
 	{	
-		#ifdef DEBUG
-			fputs( "BUTTON PRESS\n", stderr );
-	    #endif
-
 		if (!e->xbutton.subwindow) return;
+		if( !( client = window_find( e->xbutton.subwindow ) ) ) return;
 	
-	    mouse = e->xbutton;
-		window_size( mouse.subwindow, &x, &y, &w, &h );
-		window_current( mouse.subwindow );
+	    drag.mouse = e->xbutton;
+		window_check( client );
+
+		if( drag.mouse.button == 3 && !client->hinted )
+			window_hints( client );
+
+		drag.x = client->x;
+		drag.y = client->y;
+		drag.w = client->w;
+		drag.h = client->h;
+
+		drag.last = drag.mouse.time;
+		drag.pending = 0;
+		drag.motions = drag.configures = 0;
+
+		window_current( drag.mouse.subwindow );
 	}
-	else if( e->type == ButtonRelease )
+	else if( e->type == ButtonRelease && drag.mouse.subwindow && client )
 	{
-		#ifdef DEBUG
-			fputs( "BUTTON RELEASE\n", stderr );
-		#endif
+		drag.px = e->xbutton.x_root;
+		drag.py = e->xbutton.y_root;
+		drag.pending = ( drag.motions > 0 );
 
-    	mouse.subwindow = 0;
+		drag_apply( client, 1 );
+
+		drags++;
+		drag_motions    += drag.motions;
+		drag_configures += drag.configures;
+
+		// A window dropped on another output joins the workspace it shows
+		uint8_t i = outputs[output_at( drag.px, drag.py )].workspace;
+
+		if( drag.mouse.button == 1 && drag.configures && i != client->workspace )
+		{
+			window_send( client, i );
+			workspace = i;
+			window_current( client->window );
+		}
+
+		drag_end();
 	}
 }
 
 
-// configure_request()
+// drag_apply()
 //
-// Fulfill the request to configure the window
+// Move or resize the dragged window to follow the pointer, if it moved since
+// the window was last configured
 //
-// e - The given XEvent
+// client  - The client being dragged
+// release - Whether the button was released, ending the drag. Only read with
+//           OUTLINE, where a resize draws the outline until the release
 
-void configure_request( XEvent *e )
+void drag_apply( client_t *client, uint8_t release )
 {
-	#ifdef DEBUG
-		fputs( "CONFIGURE REQUEST\n", stderr );
+	timeout_cancel( &drag.timeout );
+
+	if( !drag.pending )
+		return;
+
+	rect_t r = { drag.x, drag.y, drag.w, drag.h };
+	int32_t dx = drag.px - drag.mouse.x_root;
+	int32_t dy = drag.py - drag.mouse.y_root;
+
+	// Windows are dragged across every output and snap to the edges of
+	// the output under the pointer
+	if( drag.mouse.button == 1 )
+	{
+	#ifdef SNAP
+		rect_t s = outputs[output_at( drag.px, drag.py )].r;
+		tile_t t;
+
+		if( layout_edge( s, drag.px, drag.py, config->snap, &t ) )
+			r = layout_snap( s, config->gap, t );
+		else
 	#endif
+			r = layout_move( ( rect_t ) { 0, 0, sw, sh }, r, dx, dy );
+	}
+	// Resize, to a size the client accepts
+	else if( drag.mouse.button == 3 )
+		r = layout_hints( 
+			layout_resize( AREA( client->workspace ), r, dx, dy, MINIMUM_SIZE ), 
+			&client->hints 
+		);
 
-    XConfigureRequestEvent *ev = &e->xconfigurerequest;
-    XConfigureWindow( 
-		display, 
+#ifdef OUTLINE
+	// Only the outline follows the pointer, it is erased before the one
+	// configure on release so that no trace is left on the window
+	if( drag.mouse.button == 3 )
+	{
+		r.w += client->border * 2;
+		r.h += client->border * 2;
+		outline_draw( r, !release );
+		r.w -= client->border * 2;
+		r.h -= client->border * 2;
+
+		if( !release )
+		{
+			drag.pending = 0;
+			return;
+		}
+	}
+#endif
+
+	window_move_resize( client, r );
+
+	// A dragged window leaves the layout, closing its gap
+	if( !client->floating && layouts[client->workspace] )
+	{
+		client->floating = 1;
+		workspace_tile( client->workspace );
+	}
+
+	drag.configures++;
+	drag.pending = 0;
+}
+
+
+// drag_timeout()
+//
+// Apply the motion held back by DRAG_INTERVAL once the interval is over, so
+// that a pointer coming to rest leaves the window where the pointer is
+//
+// a - Unused parameter
+
+void drag_timeout( argument_t const a )
+{
+	client_t *client = drag.mouse.subwindow ? window_find( drag.mouse.subwindow ) : NULL;
+
+	if( !client )
+		return;
+
+	drag.last += DRAG_INTERVAL;
+	drag_apply( client, 0 );
+}
+
+
+// drag_end()
+//
+// Forget the drag in progress, disarming its timer and erasing the outline
+// of a resize, which also ungrabs the server. A drag ends here however it
+// ends, its window may be gone before the button is released
+
+void drag_end()
+{
+	timeout_cancel( &drag.timeout );
+#ifdef OUTLINE
+	outline_draw( ( rect_t ) { 0 }, 0 );
+#endif
+	drag.mouse.subwindow = 0;
+	drag.pending = 0;
+}
+
+
+// configure_request()
+//
+// Fulfill the request to configure the window
+//
+// e - The given XEvent
+
+void configure_request( XEvent *e )
+{
+    XConfigureRequestEvent *ev = &e->xconfigurerequest;
+	client_t *c = window_find( ev->window );
+
+	// A tiled or fullscreen window keeps the geometry it was given. It is
+	// told so with a synthetic ConfigureNotify, as ICCCM asks, without a
+	// round through the server that would answer the client with a resize.
+	// Restacking is still honored, the server then answers that itself
+	if( c && ( c->fullscreen || ( layouts[c->workspace] && !c->floating ) ) )
+	{
+		if( ev->value_mask & CWStackMode )
+			XConfigureWindow( 
+				display, 
+				c->window, 
+				ev->value_mask & ( CWSibling | CWStackMode ), 
+				&(XWindowChanges) { .sibling = ev->above, .stack_mode = ev->detail }
+			);
+
+		if( !( ev->value_mask & ( CWX | CWY | CWWidth | CWHeight | CWBorderWidth ) ) )
+			return;
+
+		XSendEvent( 
+			display, 
+			c->window, 
+			False, 
+			StructureNotifyMask, 
+			( XEvent * ) &( XConfigureEvent ) {
+				.type         = ConfigureNotify,
+				.display      = display,
+				.event        = c->window,
+				.window       = c->window,
+				.x            = c->x,
+				.y            = c->y,
+				.width        = c->w,
+				.height       = c->h,
+				.border_width = c->border,
+				.above        = None
+			}
+		);
+
+		configures_refused++;
+		return;
+	}
+
+	if( c )
+	{
+		if( ev->value_mask & CWX )      c->x = ev->x + PARENT( c->workspace ).x;
+		if( ev->value_mask & CWY )      c->y = ev->y + PARENT( c->workspace ).y;
+		if( ev->value_mask & CWWidth )  c->w = ev->width;
+		if( ev->value_mask & CWHeight ) c->h = ev->height;
+
+		c->tile = layout_tile( AREA( c->workspace ), ( rect_t ) { c->x, c->y, c->w, c->h } );
+	}
+
+	configures_forwarded++;
+
+    XConfigureWindow( 
+		display, 
 		ev->window, 
 		ev->value_mask, 
 		&(XWindowChanges) {
-			.border_width = BORDER,
+			.border_width = config->border,
         	.x            = ev->x,
         	.y            = ev->y,
         	.width        = ev->width,
@@ -423,26 +1529,111 @@ void configure_request( XEvent *e )
 }
 
 
+// configure_notify()
+//
+// Keep the cached geometry of a managed window in sync with the server,
+// unless a new geometry is waiting for the end of the batch
+//
+// e - The given XEvent
+
+void configure_notify( XEvent *e )
+{
+	XConfigureEvent *ev = &e->xconfigure;
+	client_t *c = window_find( ev->window );
+
+	if( !c )
+		return;
+
+#ifdef OVERVIEW
+	thumbnails[c->workspace].dirty = 1;
+#endif
+
+	// A geometry queued during the batch is newer than this one, which may
+	// answer a configure sent by an earlier batch
+	if( c->configure )
+		return;
+
+	c->x      = ev->x + PARENT( c->workspace ).x;
+	c->y      = ev->y + PARENT( c->workspace ).y;
+	c->w      = ev->width;
+	c->h      = ev->height;
+	c->border = ev->border_width;
+}
+
+
 void destroy_notify( XEvent *e )
 {
-	#ifdef DEBUG
-		fputs("DESTROY NOTIFY\n", stderr );
-	#endif
+	window_delete( e->xdestroywindow.window );
+}
+
 
-//	window_delete( e->xdestroywindow.event );
+// unmap_notify()
+//
+// Handle UnmapNotify, forgetting windows their clients withdrew. Unmaps the
+// window manager caused by hiding a workspace or reparenting are expected
+// and only counted down
+//
+// e - The XEvent
+
+void unmap_notify( XEvent *e )
+{
+	client_t *c = window_find( e->xunmap.window );
+
+	if( !c )
+		return;
+
+	if( c->unmaps )
+	{
+		c->unmaps--;
+		return;
+	}
+
+	// A withdrawn window may be mapped again by another window manager
+	XDeleteProperty( display, c->window, atoms[NET_WM_DESKTOP] );
+	XDeleteProperty( display, c->window, atoms[NET_WM_STATE] );
+	XDeleteProperty( display, c->window, atoms[WM_STATE] );
+	window_delete( c->window );
 }
 
 
 void enter_notify( XEvent *e )
 {
-	#ifdef DEBUG
-		fputs( "ENTER NOTIFY\n", stderr );
-	#endif
-	XSetInputFocus(display, e->xcrossing.window, RevertToParent, CurrentTime);
+	unsigned long serial = e->xcrossing.serial;
+
+	// Crossings caused by the window manager's own maps, configures and
+	// raises are not the user moving the pointer
+	for( int i = 0; i < IGNORE_RANGES; i++ )
+		if( serial - ignores[i].from <= ignores[i].to - ignores[i].from )
+		{
+			crossings_ignored++;
+			return;
+		}
+
+	focus_request( e->xcrossing.window );
 	//window_current( e->xcrossing.window );
 }
 
 
+// crossing_ignore()
+//
+// Remember the requests made since the given serial as the window manager's
+// own, so that enter_notify() drops the crossing events they cause. A no-op
+// request closes the range, as events that follow it carry its serial
+//
+// from - NextRequest() before the requests were made
+
+void crossing_ignore( unsigned long from )
+{
+	unsigned long to = NextRequest( display ) - 1;
+
+	if( to + 1 == from )
+		return;
+
+	ignores[ignore_head++ % IGNORE_RANGES] = ( serials_t ) { from, to };
+	XNoOp( display );
+}
+
+
 // key_event()
 //
 // Respond to key events
@@ -451,44 +1642,176 @@ void enter_notify( XEvent *e )
 
 void key_event( XEvent *e )
 { 
-	#ifdef DEBUG
-		fputs( "KEY PRESS\n", stderr );
-	#endif
-
 	if( e->type == KeyPress )
 	{
-		KeySym k = XkbKeycodeToKeysym( display, e->xkey.keycode, 0, 0 );
-	
-		for( int i = 0; i < LENGTH( KEYS ); i++ )
-			if ( ( k == KEYS[i].key ) && ( CLEAN_MASK( KEYS[i].mod ) == CLEAN_MASK( e->xkey.state ) ) ) 
-				KEYS[i].f( KEYS[i].a );
+		uint8_t i = bindings[e->xkey.keycode][MASK_INDEX( e->xkey.state )];
+
+		if( i && config->keys[i - 1].f )
+			config->keys[i - 1].f( config->keys[i - 1].a );
 	}
 	else if( e->type == KeyRelease );
 }
 
 
-// map_request()
+// mapping_notify()
 //
-// Fulfill the request to map the window to the display requesting for window
-// entry events and structure change events
+// Rebuild the key bindings and grabs after the keyboard has been remapped
 //
 // e - The given XEvent
 
+void mapping_notify( XEvent *e )
+{
+	if( e->xmapping.request == MappingPointer )
+		return;
+
+	XRefreshKeyboardMapping( &e->xmapping );
+	grab_input();
+}
+
+
+// map_request()
+//
+// Manage a window as it asks to be mapped. The first rule matching the window
+// picks its workspace, geometry, floating and focus, and the window is given
+// its final geometry before it is mapped. A window bound for a workspace no
+// output shows is not mapped until that workspace is shown
+//
+// e - The MapRequest XEvent
+
 void map_request( XEvent *e )
 {
-	#ifdef DEBUG
-		fputs( "MAP REQUEST\n", stderr );
+	Window window = e->xmaprequest.window;
+	client_t *c = window_find( window );
+
+	// A managed window mapping itself again keeps its place
+	if( c )
+	{
+	#ifndef CONTAINERS
+		if( outputs[monitors[c->workspace]].workspace == c->workspace )
 	#endif
+		{
+			window_configure( c, 0 );
+			XMapWindow( display, window );
+		}
 
-	Window window = e->xmaprequest.window;
+		window_current( window );
+		return;
+	}
+
+	rule_t const *rule = rule_find( window );
+	uint8_t i = rule && rule->workspace >= 0 ? rule->workspace : workspace;
 	
-	XSelectInput( display, window, StructureNotifyMask | EnterWindowMask );
+	XSelectInput( display, window, StructureNotifyMask | EnterWindowMask | PropertyChangeMask );
+
+#ifdef CONTAINERS
+	// The save set returns the window to the root should the window manager
+	// exit and take the containers with it
+	XAddToSaveSet( display, window );
+	XReparentWindow( display, window, containers[i], 0, 0 );
+#endif
+
+	// Only a window's first map is the end of a spawn
+	process_mapped( window );
+
+	if( !( c = window_add( window, i ) ) )
+		return;
+
+	c->border = config->border;
+	XSetWindowBorderWidth( display, window, c->border );
+
+	if( rule && rule->floating >= 0 )
+		c->floating = rule->floating;
+
+	// Without a rule the layout places the window, a floating workspace
+	// gives it the whole output
+	if( rule && rule->geometry.w )
+		window_move_resize( c, ( rect_t ) { 
+			AREA( i ).x + rule->geometry.x, 
+			AREA( i ).y + rule->geometry.y, 
+			rule->geometry.w, 
+			rule->geometry.h 
+		} );
+	else if( c->floating && layouts[i] )
+		window_move_resize( c, layout_center( AREA( i ), AREA( i ).w / 2, AREA( i ).h / 2 ) );
+	else if( !layouts[i] )
+		client_fullscreen( c, 1 );
+
+	workspace_tile( i );
+
+	// A window that does not take the focus goes behind the others
+	if( rule && !rule->focus && c->next != c )
+		workspaces[i] = c->next;
+
+#ifndef CONTAINERS
+	if( outputs[monitors[i]].workspace != i )
+		window_state( window, IconicState );
+	else
+#endif
+	{
+		window_configure( c, 0 );
+		XMapWindow( display, window );
+		window_state( window, NormalState );
+	}
+
+	if( i == workspace && ( !rule || rule->focus ) )
+		window_current( window );
+}
+
+
+// client_message()
+//
+// Handle the EWMH requests of pagers and clients: fullscreen through
+// _NET_WM_STATE, focusing a window through _NET_ACTIVE_WINDOW and switching
+// workspace through _NET_CURRENT_DESKTOP
+//
+// e - The XEvent
+
+void client_message( XEvent *e )
+{
+	XClientMessageEvent *ev = &e->xclient;
+	client_t *c = window_find( ev->window );
+
+	if( ev->message_type == atoms[NET_CURRENT_DESKTOP] )
+	{
+		if( ev->data.l[0] >= 0 && ev->data.l[0] < LENGTH( workspaces ) )
+			to_workspace( ( argument_t ) { .x = ev->data.l[0] } );
+
+		return;
+	}
+
+	if( !c )
+		return;
+
+	if( ev->message_type == atoms[NET_ACTIVE_WINDOW] )
+	{
+		if( c->workspace != workspace )
+			to_workspace( ( argument_t ) { .x = c->workspace } );
+
+		window_current( c->window );
+	}
+	else if( ev->message_type == atoms[NET_WM_STATE] && 
+	         ( ev->data.l[1] == atoms[NET_WM_STATE_FULLSCREEN] || 
+	           ev->data.l[2] == atoms[NET_WM_STATE_FULLSCREEN] ) )
+	{
+		// 0 removes, 1 adds and 2 toggles the state
+		client_fullscreen( c, ev->data.l[0] == 2 ? !c->fullscreen : ev->data.l[0] == 1 );
+	}
+}
+
+
+// property_notify()
+//
+// Handle PropertyNotify, dropping the cached size hints of a window once its
+// client changes them
+//
+// e - The XEvent
 
-	window_add( window );
-	XMapWindow( display, window );
-	window_current( window );
+void property_notify( XEvent *e )
+{
+	client_t *c;
 
-	window_fullscreen( ( argument_t ) { 0 } );
+	if( e->xproperty.atom == XA_WM_NORMAL_HINTS && ( c = window_find( e->xproperty.window ) ) )
+		c->hinted = 0;
 }
 
 
@@ -497,528 +1820,5717 @@ void map_request( XEvent *e )
 ////////////////////////////////////////////////////////////////////////////////
 
 
-// window_add()
+// client_link()
 //
-// Add the given window to the workspace
+// Insert the given client at the front of a workspace ring
 //
-// window - The Window to be added
+// c - The client to be inserted
+// i - The workspace index
 
-void window_add( Window window )
+void client_link( client_t *c, uint8_t i )
 {
-	#ifdef DEBUG
-		fputs( "WINDOW ADD\n", stderr );
-	#endif
+	client_t *head = workspaces[i];
 
-	client_t *c = ( client_t * ) calloc( 1, sizeof( client_t ) );
-	c->window = window;
-	
-	if( workspaces[workspace] )
-		c->next = workspaces[workspace];
-	
-	workspaces[workspace] = c;
-	window_current( c->window );
+	if( head )
+	{
+		c->next = head;
+		c->prev = head->prev;
+		head->prev->next = c;
+		head->prev = c;
+	}
+	else
+		c->next = c->prev = c;
+
+	c->workspace = i;
+	workspaces[i] = c;
+
+#ifdef OVERVIEW
+	thumbnails[i].dirty = 1;
+#endif
 }
 
 
-// window_delete()
+// client_unlink()
 //
-// Remove the given window from the workspace
+// Remove the given client from its workspace ring
 //
-// window - The Window to be removed
+// c - The client to be removed
 
-void window_delete( Window window )
+void client_unlink( client_t *c )
 {
-	#ifdef DEBUG
-		fputs( "WINDOW DELETE\n", stderr );
-	#endif
+	if( c->next == c )
+		workspaces[c->workspace] = NULL;
+	else
+	{
+		c->prev->next = c->next;
+		c->next->prev = c->prev;
 
-	if( !workspaces[workspace] )
-		return;
+		if( workspaces[c->workspace] == c )
+			workspaces[c->workspace] = c->next;
+	}
 
-	client_t *c = workspaces[workspace];
+#ifdef OVERVIEW
+	thumbnails[c->workspace].dirty = 1;
+#endif
+
+	c->next = c->prev = NULL;
+}
 
-	if( c->window == window )
+
+// client_index()
+//
+// Add the given client to the window index, doubling the bucket count once
+// the load factor passes one
+//
+// c - The client to be indexed
+
+void client_index( client_t *c )
+{
+	if( client_count >= client_buckets )
 	{
-		free( c );
-		workspace[workspaces] = NULL;		
+		uint32_t n = client_buckets ? client_buckets * 2 : 64;
+		client_t **b = ( client_t ** ) calloc( n, sizeof( client_t * ) );
+
+		if( !b )
+			return;
+
+		for( uint32_t i = 0; i < client_buckets; i++ )
+			while( clients[i] )
+			{
+				client_t *r = clients[i];
+				clients[i] = r->link;
+				r->link = b[r->window & ( n - 1 )];
+				b[r->window & ( n - 1 )] = r;
+			}
+
+		free( clients );
+		clients = b;
+		client_buckets = n;
 	}
-	else
-	{
-		while( c->next && c->next->window != window )
-			c = c->next;
 
-		if( c->next->window == window )
-		{
-			client_t *r = c->next;
-			c->next = c->next->next;
+	c->link = clients[c->window & ( client_buckets - 1 )];
+	clients[c->window & ( client_buckets - 1 )] = c;
+	client_count++;
+}
 
-			free( r );
-		}
+
+// client_unindex()
+//
+// Remove the given client from the window index
+//
+// c - The client to be removed
+
+void client_unindex( client_t *c )
+{
+	client_t **r = &clients[c->window & ( client_buckets - 1 )];
+
+	while( *r && *r != c )
+		r = &( *r )->link;
+
+	if( *r )
+	{
+		*r = c->link;
+		client_count--;
 	}
 }
 
 
-// window_kill()
+// window_add()
 //
-// Kill the given window and respective pointer
+// Add the given window to a workspace, leaving its focus to the caller
 //
-// a - Unused parameter
+// window - The Window to be added
+// i      - The workspace
+//
+// Returns the new client, or NULL when the window is already managed
+
+client_t *window_add( Window window, uint8_t i )
+{
+	if( window_find( window ) )
+		return NULL;
+
+	client_t *c = client_alloc();
+
+	if( !c )
+		return NULL;
+
+	created++;
+	c->window = window;
+	c->order  = orders++;
+	client_index( c );
+	client_link( c, i );
+	ewmh_client_add( window );
+	ewmh_desktop( c );
+#ifdef OVERVIEW
+	thumbnail_watch( c );
+#endif
+
+	return c;
+}
+
+
+// window_adopt()
+//
+// Manage the windows that were mapped before the window manager started, or
+// that a previous instance left unmapped with an Iconic WM_STATE, each on
+// the workspace its _NET_WM_DESKTOP names. Restored clients whose windows
+// are gone, or neither mapped nor iconic, are dropped. The attributes,
+// geometry, WM_STATE and desktop of every window are requested together and
+// their replies waited for once, a single round trip
+
+void window_adopt()
+{
+	adoptee_t *windows = NULL;
+	uint32_t n = adopt_query( &windows ), adopted = 0;
+	uint16_t tiled = 0;
+
+	for( uint32_t j = 0; j < n; j++ )
+	{
+		adoptee_t *w = &windows[j];
+		uint8_t manage = ( w->replies & ( ADOPT_ATTRIBUTES | ADOPT_GEOMETRY ) ) == 
+		                 ( ADOPT_ATTRIBUTES | ADOPT_GEOMETRY ) && 
+		                 !w->override && ( w->mapped || w->iconic );
+
+		client_t *c = window_find( w->window );
+
+		// A restored window destroyed or withdrawn before its events were
+		// selected again is gone, no notify will ever tell
+		if( c && !manage )
+			window_delete( w->window );
+
+		if( c || !manage )
+			continue;
+
+		uint8_t i = w->desktop < LENGTH( workspaces ) ? w->desktop : workspace;
+		rect_t r = w->r;
+
+		XSelectInput( display, w->window, StructureNotifyMask | EnterWindowMask | PropertyChangeMask );
+
+	#ifdef CONTAINERS
+		XAddToSaveSet( display, w->window );
+		XReparentWindow( display, w->window, containers[i], 
+		                 r.x - PARENT( i ).x, r.y - PARENT( i ).y );
+
+		if( !w->viewable )
+			XMapWindow( display, w->window );
+	#else
+		uint8_t shown = outputs[monitors[i]].workspace == i;
+
+		if( shown && !w->viewable )
+			XMapWindow( display, w->window );
+	#endif
+
+		if( !( c = window_add( w->window, i ) ) )
+			continue;
+
+		c->x      = r.x;
+		c->y      = r.y;
+		c->w      = r.w;
+		c->h      = r.h;
+		c->border = config->border;
+		c->tile   = layout_tile( AREA( i ), r );
+
+		XSetWindowBorderWidth( display, w->window, c->border );
+
+	#ifdef CONTAINERS
+		c->unmaps = w->viewable;
+		window_state( w->window, NormalState );
+	#else
+		if( !shown && w->viewable )
+		{
+			c->unmaps++;
+			XUnmapWindow( display, w->window );
+		}
+
+		window_state( w->window, shown ? NormalState : IconicState );
+	#endif
+
+		if( i == workspace )
+			window_current( w->window );
+
+		tiled |= 1 << i;
+		adopted++;
+	}
+
+	free( windows );
+
+	for( int i = 0; i < LENGTH( workspaces ); i++ )
+		if( tiled & ( 1 << i ) )
+			workspace_tile( i );
+
+	if( !active_window && workspaces[workspace] )
+		window_current( workspaces[workspace]->window );
+}
+
+
+// adopt_query()
+//
+// List the children of the root not yet managed, then the managed windows,
+// with their attributes, geometry, WM_STATE and _NET_WM_DESKTOP. With XCB
+// the requests are pipelined through cookies, otherwise through an Xlib
+// async handler that takes each reply as it arrives, as
+// XGetWindowAttributes() itself does. Either way every request is sent
+// before the first reply is waited for
+//
+// windows - Set to the allocated list, to be freed by the caller
+//
+// Returns the number of windows listed
+
+uint32_t adopt_query( adoptee_t **windows )
+{
+	uint32_t n = 0;
+
+#ifdef XCB
+
+	xcb_query_tree_reply_t *tree = xcb_query_tree_reply( 
+		connection, 
+		xcb_query_tree( connection, root ), 
+		NULL 
+	);
+
+	if( !tree )
+		return 0;
+
+	xcb_window_t *tree_children = xcb_query_tree_children( tree );
+	uint32_t count = xcb_query_tree_children_length( tree );
+
+	adoptee_t *w = calloc( count + client_count + 1, sizeof( *w ) );
+	Window *children = malloc( ( count + client_count ) * sizeof( *children ) + 1 );
+	xcb_get_window_attributes_cookie_t *ac = malloc( ( count + client_count ) * sizeof( *ac ) + 1 );
+	xcb_get_geometry_cookie_t *gc = malloc( ( count + client_count ) * sizeof( *gc ) + 1 );
+	xcb_get_property_cookie_t *sc = malloc( ( count + client_count ) * sizeof( *sc ) + 1 );
+	xcb_get_property_cookie_t *dc = malloc( ( count + client_count ) * sizeof( *dc ) + 1 );
+
+	if( w && children && ac && gc && sc && dc )
+	{
+		for( uint32_t i = 0; i < count; i++ )
+			if( !window_find( tree_children[i] ) )
+				children[n++] = tree_children[i];
+
+		n += adopt_managed( children + n );
+	}
+
+	for( uint32_t i = 0; i < n; i++ )
+	{
+		ac[i] = xcb_get_window_attributes( connection, children[i] );
+		gc[i] = xcb_get_geometry( connection, children[i] );
+		sc[i] = xcb_get_property( connection, 0, children[i], atoms[WM_STATE], atoms[WM_STATE], 0, 2 );
+		dc[i] = xcb_get_property( connection, 0, children[i], atoms[NET_WM_DESKTOP], XA_CARDINAL, 0, 1 );
+	}
+
+	for( uint32_t i = 0; i < n; i++ )
+	{
+		xcb_get_window_attributes_reply_t *a = xcb_get_window_attributes_reply( connection, ac[i], NULL );
+		xcb_get_geometry_reply_t *g = xcb_get_geometry_reply( connection, gc[i], NULL );
+		xcb_get_property_reply_t *s = xcb_get_property_reply( connection, sc[i], NULL );
+		xcb_get_property_reply_t *d = xcb_get_property_reply( connection, dc[i], NULL );
+
+		w[i].window  = children[i];
+		w[i].desktop = ~0u;
+
+		if( a )
+		{
+			w[i].replies |= ADOPT_ATTRIBUTES;
+			w[i].viewable = a->map_state == XCB_MAP_STATE_VIEWABLE;
+			w[i].mapped   = a->map_state != XCB_MAP_STATE_UNMAPPED;
+			w[i].override = a->override_redirect;
+		}
+
+		if( g )
+		{
+			w[i].replies |= ADOPT_GEOMETRY;
+			w[i].r        = ( rect_t ) { g->x, g->y, g->width, g->height };
+		}
+
+		if( s && s->format == 32 && xcb_get_property_value_length( s ) >= 4 )
+			w[i].iconic = *( uint32_t * ) xcb_get_property_value( s ) == IconicState;
+
+		if( d && d->format == 32 && xcb_get_property_value_length( d ) >= 4 )
+			w[i].desktop = *( uint32_t * ) xcb_get_property_value( d );
+
+		free( a );
+		free( g );
+		free( s );
+		free( d );
+	}
+
+	free( children );
+	free( ac );
+	free( gc );
+	free( sc );
+	free( dc );
+	free( tree );
+
+#else // XCB
+
+	Display *dpy = display;
+	Window *tree_children = NULL;
+	uint32_t count;
+
+	if( !XQueryTree( display, root, &(Window){0}, &(Window){0}, &tree_children, &count ) )
+		return 0;
+
+	adoptee_t *w = calloc( count + client_count + 1, sizeof( *w ) );
+	Window *children = malloc( ( count + client_count ) * sizeof( *children ) + 1 );
+
+	if( w && children )
+	{
+		for( uint32_t i = 0; i < count; i++ )
+			if( !window_find( tree_children[i] ) )
+				children[n++] = tree_children[i];
+
+		n += adopt_managed( children + n );
+	}
+
+	LockDisplay( dpy );
+
+	adoption_t adoption = { NextRequest( dpy ), n, w };
+	_XAsyncHandler handler = { dpy->async_handlers, adopt_reply, ( XPointer ) &adoption };
+	dpy->async_handlers = &handler;
+
+	for( uint32_t i = 0; i < n; i++ )
+	{
+		xResourceReq *req;
+		xGetPropertyReq *prop;
+
+		w[i].window  = children[i];
+		w[i].desktop = ~0u;
+
+		GetResReq( GetWindowAttributes, children[i], req );
+		GetResReq( GetGeometry, children[i], req );
+
+		GetReq( GetProperty, prop );
+		prop->window     = children[i];
+		prop->property   = atoms[WM_STATE];
+		prop->type       = atoms[WM_STATE];
+		prop->delete     = False;
+		prop->longOffset = 0;
+		prop->longLength = 2;
+
+		GetReq( GetProperty, prop );
+		prop->window     = children[i];
+		prop->property   = atoms[NET_WM_DESKTOP];
+		prop->type       = XA_CARDINAL;
+		prop->delete     = False;
+		prop->longOffset = 0;
+		prop->longLength = 1;
+	}
+
+	UnlockDisplay( dpy );
+
+	// The replies are handed to adopt_reply() on the way to this one
+	XSync( dpy, False );
+
+	LockDisplay( dpy );
+	DeqAsyncHandler( dpy, &handler );
+	UnlockDisplay( dpy );
+
+	if( tree_children )
+		XFree( tree_children );
+
+	free( children );
+
+#endif // XCB
+
+	*windows = w;
+
+	return n;
+}
+
+
+// adopt_managed()
+//
+// List the windows already managed, those restored from a snapshot, so that
+// their queries tell which were destroyed or withdrawn while no window
+// manager was listening. With CONTAINERS they are not children of the root
+//
+// list - Filled with the windows, room for client_count of them
+//
+// Returns the number of windows listed
+
+uint32_t adopt_managed( Window *list )
+{
+	uint32_t n = 0;
+
+	for( int i = 0; i < LENGTH( workspaces ); i++ )
+	{
+		client_t *c = workspaces[i];
+
+		if( c )
+			do list[n++] = c->window;
+			while( ( c = c->next ) != workspaces[i] );
+	}
+
+	return n;
+}
+
+
+#ifndef XCB
+// adopt_reply()
+//
+// Take the reply, or error, to one of the queries of adopt_query(). The
+// query is told by its sequence number, there are ADOPT_QUERIES a window
+//
+// d    - The display
+// rep  - The reply
+// buf  - Passed on to _XGetAsyncReply()
+// len  - Passed on to _XGetAsyncReply()
+// data - The adoption_t being filled
+//
+// Returns whether the reply was one of the queries
+
+Bool adopt_reply( Display *d, xReply *rep, char *buf, int len, XPointer data )
+{
+	adoption_t *a = ( adoption_t * ) data;
+	unsigned long query = d->last_request_read - a->first;
+
+	if( d->last_request_read < a->first || query >= a->n * ADOPT_QUERIES )
+		return False;
+
+	adoptee_t *w = &a->windows[query / ADOPT_QUERIES];
+
+	// A window destroyed meanwhile answers with an error, and is left out
+	if( rep->generic.type == X_Error )
+		return True;
+
+	switch( query % ADOPT_QUERIES )
+	{
+		case 0:
+		{
+			xGetWindowAttributesReply b;
+			xGetWindowAttributesReply *r = ( xGetWindowAttributesReply * ) _XGetAsyncReply( 
+				d, ( char * ) &b, rep, buf, len, 
+				( SIZEOF( xGetWindowAttributesReply ) - SIZEOF( xReply ) ) >> 2, True 
+			);
+
+			w->replies |= ADOPT_ATTRIBUTES;
+			w->viewable = r->mapState == IsViewable;
+			w->mapped   = r->mapState != IsUnmapped;
+			w->override = r->override;
+			break;
+		}
+
+		case 1:
+		{
+			xGetGeometryReply *g = ( xGetGeometryReply * ) rep;
+
+			w->replies |= ADOPT_GEOMETRY;
+			w->r        = ( rect_t ) { g->x, g->y, g->width, g->height };
+			break;
+		}
+
+		default:
+		{
+			struct { xGetPropertyReply h; CARD32 value; } b;
+			uint8_t extra = MIN( rep->generic.length, 1 );
+			xGetPropertyReply *p = ( xGetPropertyReply * ) _XGetAsyncReply( 
+				d, ( char * ) &b, rep, buf, len, extra, True 
+			);
+
+			if( !extra || p->format != 32 || !p->nItems )
+				break;
+
+			CARD32 value = *( CARD32 * ) ( ( char * ) p + SIZEOF( xGetPropertyReply ) );
+
+			if( query % ADOPT_QUERIES == 2 )
+				w->iconic = value == IconicState;
+			else
+				w->desktop = value;
+		}
+	}
+
+	return True;
+}
+#endif
+
+
+// window_state()
+//
+// Set the ICCCM WM_STATE of a window, Iconic while the window manager keeps
+// it unmapped on a hidden workspace, so that the next instance adopts it
+//
+// window - The Window
+// state  - NormalState or IconicState
+
+void window_state( Window window, long state )
+{
+	long data[] = { state, None };
+
+	XChangeProperty( display, window, atoms[WM_STATE], atoms[WM_STATE], 32, PropModeReplace, 
+	                 ( unsigned char * ) data, 2 );
+	property_writes++;
+}
+
+
+// window_delete()
+//
+// Remove the given window from whichever workspace holds it
+//
+// window - The Window to be removed
+
+void window_delete( Window window )
+{
+	client_t *c = window_find( window );
+
+	if( !c )
+		return;
+
+	uint8_t i = c->workspace;
+
+	removed++;
+
+	if( focus_pending == window )
+		focus_pending = None;
+
+	if( active_window == window )
+		active_window = None;
+
+	// A drag of the window ends with it, the slot is about to be reused
+	if( drag.mouse.subwindow == window )
+		drag_end();
+
+	ewmh_client_remove( window );
+#ifdef OVERVIEW
+	thumbnail_forget( c );
+#endif
+	client_unlink( c );
+	client_unindex( c );
+	client_free( c );
+
+	workspace_tile( i );
+}
+
+
+// client_alloc()
+//
+// Take a zeroed client from the pool, growing the pool by a slab of
+// POOL_SLAB clients when it is empty. Slabs are never returned, the pool
+// only grows to the most clients ever managed at once
+//
+// Returns the client, or NULL when out of memory
+
+client_t *client_alloc()
+{
+	if( !pool )
+	{
+		client_t *slab = malloc( POOL_SLAB * sizeof( client_t ) );
+
+		if( !slab )
+			return NULL;
+
+		for( int i = 0; i < POOL_SLAB; i++ )
+			client_free( &slab[i] );
+
+		pool_slabs++;
+	}
+
+	client_t *c = pool;
+	pool = c->next;
+	pool_idle--;
+
+	memset( c, 0, sizeof( *c ) );
+
+	return c;
+}
+
+
+// client_free()
+//
+// Return a client to the pool
+//
+// c - The unlinked and unindexed client
+
+void client_free( client_t *c )
+{
+	c->next = pool;
+	pool = c;
+	pool_idle++;
+}
+
+
+// window_find()
+//
+// Find the client of the given window in any workspace
+//
+// window - The Window to be found
+
+client_t *window_find( Window window )
+{
+	if( !client_buckets )
+		return NULL;
+
+	client_t *c = clients[window & ( client_buckets - 1 )];
+
+	while( c && c->window != window )
+		c = c->link;
+
+	return c;
+}
+
+
+// window_move_resize()
+//
+// Move and resize the window of the given client, recording the requested
+// geometry and its tile in the client's cache. The configure is sent at the
+// end of the batch, with the last geometry the batch gave the window
+//
+// c - The client to be configured
+// r - The new geometry
+
+void window_move_resize( client_t *c, rect_t r )
+{
+	c->x    = r.x;
+	c->y    = r.y;
+	c->w    = r.w;
+	c->h    = r.h;
+	c->tile = layout_tile( AREA( c->workspace ), r );
+
+	if( c->fullscreen )
+	{
+		c->fullscreen = 0;
+		ewmh_state( c );
+	}
+
+	batch_configure( c );
+}
+
+
+// window_check()
+//
+// Compare the cached geometry of the given client against the server. Only
+// active with BENCHMARK as it costs a round trip, and skipped while a
+// configure is still held for the end of the batch
+//
+// c - The client to be checked
+
+void window_check( client_t *c )
+{
+#ifdef BENCHMARK
+	int32_t x, y;
+	uint32_t w, h, border;
+
+	if( !c || c->configure || !XGetGeometry( display, c->window, &(Window){0}, 
+	                         &x, &y, &w, &h, &border, &(unsigned int){0} ) )
+		return;
+
+	x += PARENT( c->workspace ).x;
+	y += PARENT( c->workspace ).y;
+
+	if( x != c->x || y != c->y || w != c->w || h != c->h || border != c->border )
+		fprintf( 
+			stderr, 
+			"GEOMETRY MISMATCH %lx: cache %d %d %u %u %u server %d %d %u %u %u\n",
+			c->window, c->x, c->y, c->w, c->h, c->border, x, y, w, h, border 
+		);
+#endif
+}
+
+
+// window_hints()
+//
+// Read and cache the WM_NORMAL_HINTS of a client, a round trip
+//
+// c - The client
+
+void window_hints( client_t *c )
+{
+	XSizeHints size;
+	hints_t *h = &c->hints;
+
+	*h = ( hints_t ) {0};
+	c->hinted = 1;
+
+	if( !XGetWMNormalHints( display, c->window, &size, &(long){0} ) )
+		return;
+
+	if( size.flags & PMinSize )
+	{
+		h->min_w = MAX( size.min_width, 0 );
+		h->min_h = MAX( size.min_height, 0 );
+	}
+
+	if( size.flags & PMaxSize )
+	{
+		h->max_w = MAX( size.max_width, 0 );
+		h->max_h = MAX( size.max_height, 0 );
+	}
+
+	if( size.flags & PBaseSize )
+	{
+		h->base_w = MAX( size.base_width, 0 );
+		h->base_h = MAX( size.base_height, 0 );
+	}
+
+	if( size.flags & PResizeInc )
+	{
+		h->inc_w = MAX( size.width_inc, 0 );
+		h->inc_h = MAX( size.height_inc, 0 );
+	}
+
+	if( !( size.flags & PBaseSize ) )
+	{
+		h->base_w = h->min_w;
+		h->base_h = h->min_h;
+	}
+	else if( !( size.flags & PMinSize ) )
+	{
+		h->min_w = h->base_w;
+		h->min_h = h->base_h;
+	}
+}
+
+
+// window_kill()
+//
+// Kill the given window and respective pointer
+//
+// a - Unused parameter
+
+void window_kill( argument_t const a )
+{
+    if( workspaces[workspace] ) 
+	{
+		XKillClient( display, workspaces[workspace]->window );
+		window_delete( workspaces[workspace]->window );
+		
+		if( workspaces[workspace] )
+			window_current( workspaces[workspace]->window );
+	}
+}
+
+
+// window_current()
+//
+// Raise, focus and move the given window to front of the client list
+//
+// window - The Window to be raised and focused
+
+void window_current( Window window )
+{
+	client_t *c = window_find( window );
+
+	if( !c || c->workspace != workspace )
+		return;
+
+	// Only moves client if it is not at the front
+	if( workspaces[workspace] != c )
+	{
+		client_unlink( c );
+		client_link( c, workspace );
+    }
+
+	focus_request( window );
+	batch_raise( c );
+}
+
+
+// focus_request()
+//
+// Ask for the input focus to move to a window at the end of the batch of
+// events being handled, only the last request of a batch is sent
+//
+// window - The Window to be focused
+
+void focus_request( Window window )
+{
+	focus_pending = window;
+	focus_requests++;
+	batch_queued++;
+}
+
+
+// focus_flush()
+//
+// Send the focus requested during the batch. It is sent even when it names
+// the window focused last, as clients may have moved the focus since
+
+void focus_flush()
+{
+	if( !focus_pending )
+		return;
+
+	XSetInputFocus( display, focus_pending, RevertToParent, CurrentTime );
+	active_window = focus_pending;
+	focus_pending = None;
+	focus_sets++;
+	batch_sent++;
+}
+
+
+// window_configure()
+//
+// Send the geometry a client is waiting for, and raise it, as one configure.
+// Used by the end of the batch, and ahead of a map so that a window is never
+// shown at the geometry it had before
+//
+// c     - The client
+// raise - Whether the window is raised as well
+
+void window_configure( client_t *c, uint8_t raise )
+{
+	XWindowChanges changes = { 
+		.x          = c->x - PARENT( c->workspace ).x, 
+		.y          = c->y - PARENT( c->workspace ).y, 
+		.width      = c->w, 
+		.height     = c->h, 
+		.stack_mode = Above 
+	};
+	unsigned int mask = ( c->configure ? CWX | CWY | CWWidth | CWHeight : 0 ) | 
+	                    ( raise ? CWStackMode : 0 );
+
+	if( !mask )
+		return;
+
+	XConfigureWindow( display, c->window, mask, &changes );
+	c->configure = 0;
+	batch_sent++;
+}
+
+
+// batch_configure()
+//
+// Hold the configure of a client until the end of the batch, queuing its
+// window once however often its geometry changes. Should the queue fill, the
+// configure is sent at once
+//
+// c - The client whose cached geometry changed
+
+void batch_configure( client_t *c )
+{
+	batch_queued++;
+
+	if( c->configure )
+		return;
+
+	c->configure = 1;
+
+	if( configure_count < MAX_BATCH )
+		configure_queue[configure_count++] = c->window;
+	else
+		window_configure( c, 0 );
+}
+
+
+// batch_raise()
+//
+// Hold the raise of a client until the end of the batch. A full queue is
+// stacked at once, keeping the order of the raises
+//
+// c - The client to be raised
+
+void batch_raise( client_t *c )
+{
+	batch_queued++;
+
+	if( raise_count == MAX_BATCH )
+		batch_stack();
+
+	raise_queue[raise_count++] = c->window;
+	c->raise = raise_count;
+}
+
+
+// batch_stack()
+//
+// Raise the queued windows in the order of their last raise, each together
+// with its pending geometry
+
+void batch_stack()
+{
+	for( uint32_t j = 0; j < raise_count; j++ )
+	{
+		client_t *c = window_find( raise_queue[j] );
+
+		if( !c || c->raise != j + 1 )
+			continue;
+
+		window_configure( c, 1 );
+		c->raise = 0;
+	}
+
+	raise_count = 0;
+}
+
+
+// batch_flush()
+//
+// End a batch, sending the net result of its handlers: a configure for each
+// window that moved or was raised, the focus, and the root properties, with
+// a single flush. The crossing events of the configures are dropped, and the
+// requests the batch saved are recorded
+//
+// events - The X events handled in the batch
+
+void batch_flush( uint32_t events )
+{
+	unsigned long serial = NextRequest( display );
+
+	batch_stack();
+
+	for( uint32_t j = 0; j < configure_count; j++ )
+	{
+		client_t *c = window_find( configure_queue[j] );
+
+		if( c )
+			window_configure( c, 0 );
+	}
+
+	configure_count = 0;
+	crossing_ignore( serial );
+	focus_flush();
+	ewmh_flush();
+	XFlush( display );
+
+	if( !events && !batch_queued )
+		return;
+
+	batches++;
+	requests_queued += batch_queued;
+	requests_sent   += batch_sent;
+	histogram_add( &batch_events, events );
+	histogram_add( &batch_coalesced, batch_queued - batch_sent );
+
+	batch_queued = 0;
+	batch_sent   = 0;
+}
+
+
+// window_center()
+//
+// Center the given window on the screen
+//
+// window - The Window to be centered
+
+void window_center( Window window )
+{
+	client_t *c = window_find( window );
+
+	if( !c )
+		return;
+
+	window_move_resize( c, layout_center( AREA( c->workspace ), c->w, c->h ) );
+}
+
+
+// window_fullscreen()
+//
+// Resize the current window to take up the full screen
+//
+// a - Unused parameter
+
+void window_fullscreen( argument_t const a )
+{
+	if( !workspaces[workspace] )
+		return;
+
+	client_fullscreen( workspaces[workspace], 1 );
+}
+
+
+// client_fullscreen()
+//
+// Make a client fullscreen on its output, floating it out of the layout, or
+// return it to the layout or the center of its output
+//
+// c  - The client
+// on - Whether the client becomes fullscreen
+
+void client_fullscreen( client_t *c, uint8_t on )
+{
+	rect_t s = AREA( c->workspace );
+
+	if( !on )
+	{
+		if( !c->fullscreen )
+			return;
+
+		if( layouts[c->workspace] )
+		{
+			c->floating = 0;
+			workspace_tile( c->workspace );
+		}
+		else
+			window_move_resize( c, layout_center( s, s.w / 2, s.h / 2 ) );
+
+		return;
+	}
+
+	window_move_resize( c, layout_snap( s, config->gap, ( tile_t ) { 0, 0 } ) );
+
+	c->fullscreen = 1;
+	ewmh_state( c );
+
+	if( !c->floating && layouts[c->workspace] )
+	{
+		c->floating = 1;
+		workspace_tile( c->workspace );
+	}
+}
+
+
+void window_next( argument_t const a )
+{
+	if( !workspaces[workspace] )
+		return;
+
+	workspaces[workspace] = workspaces[workspace]->next;
+	window_current( workspaces[workspace]->window );
+}
+
+
+void window_previous( argument_t const a )
+{
+	if( !workspaces[workspace] )
+		return;
+
+	workspaces[workspace] = workspaces[workspace]->prev;
+	window_current( workspaces[workspace]->window );
+}
+
+
+// window_push()
+//
+// Tile the current window toward the given direction, a window already at
+// that edge stays put
+//
+// a.x - 0 right, 1 up, 2 left, 3 down
+
+void window_push( argument_t const a )
+{
+	if( !workspaces[workspace] )
+		return;
+
+	client_t *c = workspaces[workspace];
+	tile_t t = layout_push( c->tile, a.x );
+
+	window_check( c );
+
+	if( t.x == c->tile.x && t.y == c->tile.y )
+		return;
+
+    window_move_resize( c, layout_snap( AREA( workspace ), config->gap, t ) );
+
+	if( !c->floating && layouts[workspace] )
+	{
+		c->floating = 1;
+		workspace_tile( workspace );
+	}
+}
+
+
+// window_to_workspace()
+//
+// Move the window to the given workpace
+//
+// a.x - The workspace to move the current window to
+
+void window_to_workspace( argument_t const a ) 
+{
+	if( !workspaces[workspace] || a.x == workspace) 
+		return;
+
+	client_t *c = workspaces[workspace];
+	rect_t from = AREA( workspace ), to = AREA( a.x );
+
+	// A window sent to another output keeps its place relative to the output
+	if( from.x != to.x || from.y != to.y )
+	{
+		rect_t r = layout_move( 
+			to, 
+			( rect_t ) { c->x + to.x - from.x, c->y + to.y - from.y, c->w, c->h }, 
+			0, 
+			0 
+		);
+
+		c->x = r.x;
+		c->y = r.y;
+
+	#ifndef CONTAINERS
+		batch_configure( c );
+	#endif
+	}
+
+	window_send( c, a.x );
+	workspace_tile( workspace );
+	workspace_tile( a.x );
+
+	if( workspaces[workspace] )
+		window_current( workspaces[workspace]->window );
+}
+
+
+// window_send()
+//
+// Move a client to a workspace as it is, hiding it unless an output shows
+// that workspace
+//
+// c - The client
+// i - The workspace
+
+void window_send( client_t *c, uint8_t i )
+{
+	client_unlink( c );
+	client_link( c, i );
+	ewmh_desktop( c );
+
+#ifdef CONTAINERS
+	// Reparenting a mapped window unmaps it on the way
+	c->unmaps++;
+	XReparentWindow( display, c->window, containers[i], c->x - AREA( i ).x, c->y - AREA( i ).y );
+#else
+	if( outputs[monitors[i]].workspace != i )
+	{
+		c->unmaps++;
+		XUnmapWindow( display, c->window );
+		window_state( c->window, IconicState );
+	}
+#endif
+}
+
+
+// window_float()
+//
+// Toggle whether the current window is left out of the automatic layout. A
+// window rejoining the layout goes to the end of it
+
+void window_float( argument_t const a )
+{
+	client_t *c = workspaces[workspace];
+
+	if( !c )
+		return;
+
+	c->floating = !c->floating;
+
+	if( !c->floating )
+		c->order = orders++;
+
+	workspace_tile( workspace );
+}
+
+
+// window_swap()
+//
+// Swap the current window with the first window of the layout, or the first
+// window with the second when it is the current window
+
+void window_swap( argument_t const a )
+{
+	client_t *c = workspaces[workspace], *first = NULL, *second = NULL;
+
+	if( !c || c->floating || !layouts[workspace] )
+		return;
+
+	client_t *i = c;
+
+	do
+	{
+		if( i->floating )
+			continue;
+
+		if( !first || i->order < first->order )
+		{
+			second = first;
+			first = i;
+		}
+		else if( !second || i->order < second->order )
+			second = i;
+	}
+	while( ( i = i->next ) != c );
+
+	client_t *other = c == first ? second : first;
+
+	if( !other )
+		return;
+
+	uint32_t order = c->order;
+	c->order = other->order;
+	other->order = order;
+
+	workspace_tile( workspace );
+}
+
+
+// workspace_layout()
+//
+// Change the layout of the current workspace
+//
+// a.x - The layout_t to be applied
+
+void workspace_layout( argument_t const a )
+{
+	if( a.x >= LAYOUT_COUNT || layouts[workspace] == a.x )
+		return;
+
+	layouts[workspace] = a.x;
+	workspace_tile( workspace );
+}
+
+
+// workspace_tile()
+//
+// Lay out the tiled windows of a workspace, configuring only the windows
+// whose rectangle changed so that an event costs a configure per moved
+// window rather than one per window
+//
+// i - The workspace
+
+void workspace_tile( uint8_t i )
+{
+	static client_t **tiled;
+	static rect_t *r;
+	static uint32_t size;
+	uint32_t n = 0;
+	client_t *c = workspaces[i];
+
+	if( !layouts[i] || !c )
+		return;
+
+	// Gather the tiled windows, sorted by order with an insertion sort as
+	// the ring is mostly in order already
+	do
+	{
+		if( c->floating )
+			continue;
+
+		if( n == size )
+		{
+			uint32_t grown = size ? size * 2 : 32;
+			client_t **t = realloc( tiled, grown * sizeof( *tiled ) );
+			rect_t *q = t ? realloc( r, grown * sizeof( *r ) ) : NULL;
+
+			if( t ) tiled = t;
+			if( q ) r = q;
+			if( !t || !q ) return;
+
+			size = grown;
+		}
+
+		uint32_t j = n++;
+
+		for( ; j > 0 && tiled[j - 1]->order > c->order; j-- )
+			tiled[j] = tiled[j - 1];
+
+		tiled[j] = c;
+	}
+	while( ( c = c->next ) != workspaces[i] );
+
+	layout_tiles( layouts[i], AREA( i ), config->gap, n, r );
+
+	for( uint32_t j = 0; j < n; j++ )
+	{
+		c = tiled[j];
+
+		// The tile holds the window with its border
+		r[j].w = MAX( r[j].w, 2 * config->border + 1 ) - 2 * config->border;
+		r[j].h = MAX( r[j].h, 2 * config->border + 1 ) - 2 * config->border;
+
+		if( c->x == r[j].x && c->y == r[j].y && c->w == r[j].w && c->h == r[j].h )
+			continue;
+
+		window_move_resize( c, r[j] );
+	}
+}
+
+
+// to_workspace()
+//
+// Move to the given workpace. With CONTAINERS this maps the new workspace's
+// container and unmaps the old one, otherwise every client of both
+// workspaces is mapped or unmapped in turn. BENCHMARK times the switch to
+// the server and back, so that the two can be compared
+//
+// a.x - The workspace to move to
+
+void to_workspace( argument_t const a )
+{
+    if (a.x == workspace)
+		return;
+
+	output_t *o = &outputs[monitors[a.x]];
+
+#ifdef OVERVIEW
+	if( overview_window )
+		overview_close();
+
+	// A hidden workspace has nothing left to render, its thumbnail is taken
+	// before it goes
+	if( o->workspace != a.x && thumbnails[o->workspace].dirty )
+		thumbnail_render( o->workspace );
+#endif
+
+	// Only the output of the workspace changes, a workspace already shown on
+	// its output is just focused
+	if( o->workspace != a.x )
+	{
+		// Show first so the root never shows between the two
+		workspace_show( a.x, 1 );
+		workspace_show( o->workspace, 0 );
+		o->workspace = a.x;
+	}
+
+	workspace = a.x;
+
+    if( workspaces[workspace] ) 
+		window_current( workspaces[workspace]->window ); 
+} 
+
+
+// workspace_show()
+//
+// Map or unmap the windows of a workspace
+//
+// i    - The workspace
+// show - Whether to map or unmap
+
+void workspace_show( uint8_t i, uint8_t show )
+{
+	client_t *c = workspaces[i];
+
+	// Windows laid out while hidden are moved before they are seen
+	if( c && show )
+		do window_configure( c, 0 );
+		while( ( c = c->next ) != workspaces[i] );
+
+#ifdef CONTAINERS
+
+	if( show )
+		XMapWindow( display, containers[i] );
+	else
+		XUnmapWindow( display, containers[i] );
+
+#else // CONTAINERS
+
+	if( c )
+		do
+		{
+			if( show )
+				XMapWindow( display, c->window );
+			else
+			{
+				c->unmaps++;
+				XUnmapWindow( display, c->window );
+			}
+
+			// The next instance adopts the windows left unmapped
+			window_state( c->window, show ? NormalState : IconicState );
+		}
+		while( ( c = c->next ) != workspaces[i] );
+
+#endif // CONTAINERS
+}
+
+
+// run()
+//
+// Spawn the given program in a session of its own. The $PATH lookup is
+// cached, and a failed exec is reported here as posix_spawn() returns
+//
+// a.p - A pointer to the array of command strings
+
+void run( argument_t const a )
+{
+	extern char **environ;
+	char **argv = ( char ** ) a.p;
+	posix_spawnattr_t attr;
+	posix_spawn_file_actions_t actions;
+	sigset_t mask;
+	pid_t pid;
+	int error = ENOENT;
+
+	if( !argv || !argv[0] )
+		return;
+
+	// Children start with no signals blocked, unlike the signalfd loop
+	sigemptyset( &mask );
+	posix_spawnattr_init( &attr );
+	posix_spawnattr_setsigmask( &attr, &mask );
+	posix_spawnattr_setflags( &attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSID );
+	posix_spawn_file_actions_init( &actions );
+
+    if( display )
+		posix_spawn_file_actions_addclose( &actions, ConnectionNumber( display ) );
+
+	// A cached path gone stale is looked up again once
+	for( uint8_t retry = 0; retry < 2 && error; retry++ )
+	{
+		char const *path = process_path( argv[0], retry );
+
+		if( !path )
+			break;
+
+		error = posix_spawn( &pid, path, &actions, &attr, argv, environ );
+	}
+
+	posix_spawn_file_actions_destroy( &actions );
+	posix_spawnattr_destroy( &attr );
+
+	if( error )
+	{
+		fprintf( stderr, "RUN %s: %s\n", argv[0], strerror( error ) );
+		return;
+	}
+
+	process_add( pid, argv[0] );
+}
+
+
+// quit()
+//
+// Quit the window manager
+//
+// a - Unused parameter
+
+void quit( argument_t const a )
+{
+	loop = 0;
+}
+
+
+// grab_input()
+//
+// Determine which keys to send events for. Builds the bindings table used by
+// key_event() and diffs the wanted key grabs against the current ones so that
+// a remap only grabs and ungrabs the keys that changed
+
+void grab_input()
+{	
+	static uint32_t grabbed_lock = -1, grabbed_mod;
+	key_input_t const *keys = config->keys;
+	uint8_t want[256][256 / 8] = {0};
+	KeyCode codes[MAX_KEYS], numlock, *modifiers;
+	uint32_t per;
+    uint32_t i, j;
+
+#ifdef XCB
+
+	// Both requests are in flight before either reply is awaited, costing a
+	// single round trip where Xlib needs one for each
+	xcb_setup_t const *setup = xcb_get_setup( connection );
+
+	xcb_get_modifier_mapping_cookie_t mc = xcb_get_modifier_mapping( connection );
+	xcb_get_keyboard_mapping_cookie_t kc = xcb_get_keyboard_mapping( 
+		connection, 
+		setup->min_keycode, 
+		setup->max_keycode - setup->min_keycode + 1 
+	);
+
+	xcb_get_modifier_mapping_reply_t *mr = xcb_get_modifier_mapping_reply( connection, mc, NULL );
+	xcb_get_keyboard_mapping_reply_t *kr = xcb_get_keyboard_mapping_reply( connection, kc, NULL );
+
+	if( !mr || !kr )
+	{
+		free( mr );
+		free( kr );
+		return;
+	}
+
+	numlock = keysym_to_keycode( kr, XK_Num_Lock );
+    for( i = 0; i < config->key_count; i++ )
+		codes[i] = keysym_to_keycode( kr, keys[i].key );
+
+	per = mr->keycodes_per_modifier;
+	modifiers = xcb_get_modifier_mapping_keycodes( mr );
+
+#else // XCB
+
+    XModifierKeymap *modmap = XGetModifierMapping( display );
+
+	numlock = XKeysymToKeycode( display, XK_Num_Lock );
+    for( i = 0; i < config->key_count; i++ )
+		codes[i] = XKeysymToKeycode( display, keys[i].key );
+
+	per = modmap->max_keypermod;
+	modifiers = modmap->modifiermap;
+
+#endif // XCB
+
+	// NumLock
+	NumLockMask = 0;
+    for( i = 0; i < 8; i++ )
+        for( j = 0; j < per; j++ )
+            if( numlock && modifiers[i * per + j] == numlock )
+                NumLockMask = (1 << i);
+
+#ifdef XCB
+	free( mr );
+	free( kr );
+#else
+    XFreeModifiermap(modmap);
+#endif
+
+	uint32_t null_modifiers[] = { 
+		0, 
+		LockMask, 
+		NumLockMask, 
+		NumLockMask|LockMask
+	};
+
+	// Keys, the first binding wins when several overlap. A binding without
+	// an action holds its key ungrabbed
+	memset( bindings, 0, sizeof( bindings ) );
+
+    for( i = 0; i < config->key_count; i++ )
+	{
+		KeyCode k = codes[i];
+
+		if( !k || bindings[k][MASK_INDEX( keys[i].mod )] )
+			continue;
+
+		bindings[k][MASK_INDEX( keys[i].mod )] = i + 1;
+
+		if( !keys[i].f )
+			continue;
+
+        for( j = 0; j < LENGTH( null_modifiers ); j++ )
+		{
+			uint8_t m = keys[i].mod | null_modifiers[j];
+			want[k][m / 8] |= 1 << m % 8;
+		}
+	}
+
+	for( i = 0; i < 256; i++ )
+		for( j = 0; j < 256; j++ )
+		{
+			uint8_t had = grabs[i][j / 8] >> j % 8 & 1;
+			uint8_t has = want[i][j / 8] >> j % 8 & 1;
+
+			if( had && !has )
+				XUngrabKey( display, i, j, root );
+			else if( has && !had )
+				XGrabKey( display, i, j, root, True, GrabModeAsync, GrabModeAsync );
+		}
+
+	memcpy( grabs, want, sizeof( grabs ) );
+
+	// Buttons, only regrabbed when the lock modifiers or MOD move. Containers
+	// cover the root so they take the grabs, leaving the client as the subwindow
+	if( grabbed_lock == NumLockMask && grabbed_mod == config->mod )
+		return;
+
+#ifdef CONTAINERS
+	Window *targets = containers;
+	uint32_t n = LENGTH( containers );
+#else
+	Window *targets = &root;
+	uint32_t n = 1;
+#endif
+
+	for( uint32_t t = 0; t < n; t++ )
+	{
+		if( grabbed_lock != -1 )
+			XUngrabButton( display, AnyButton, AnyModifier, targets[t] );
+
+    	for( i = 1; i < 4; i += 1 )
+    	    for( j = 0; j < LENGTH( null_modifiers); j++ )
+    	        XGrabButton(
+					display, 
+					i, 
+					config->mod | null_modifiers[j], 
+					targets[t], 
+					True,
+    	            ButtonPressMask|ButtonReleaseMask|PointerMotionMask|PointerMotionHintMask,
+    	            GrabModeAsync, 
+					GrabModeAsync, 
+					0, 
+					0
+				);
+	}
+
+	grabbed_lock = NumLockMask;
+	grabbed_mod  = config->mod;
+}
+
+
+#ifdef XCB
+
+// keysym_to_keycode()
+//
+// Find the first keycode producing the given keysym, searching columns in
+// the same order as XKeysymToKeycode()
+//
+// r      - A keyboard mapping reply starting at the minimum keycode
+// keysym - The keysym to be found
+
+KeyCode keysym_to_keycode( xcb_get_keyboard_mapping_reply_t *r, KeySym keysym )
+{
+	xcb_keysym_t *syms = xcb_get_keyboard_mapping_keysyms( r );
+	uint32_t n = xcb_get_keyboard_mapping_keysyms_length( r );
+	uint8_t  per = r->keysyms_per_keycode;
+
+	for( uint32_t j = 0; j < per; j++ )
+		for( uint32_t i = j; i < n; i += per )
+			if( syms[i] == keysym )
+				return xcb_get_setup( connection )->min_keycode + i / per;
+
+	return 0;
+}
+
+#endif // XCB
+
+
+////////////////////////////////////////////////////////////////////////////////
+// OUTPUT
+////////////////////////////////////////////////////////////////////////////////
+
+
+// output_update()
+//
+// Read the outputs from RandR, or take the whole screen as one. Workspaces
+// stay on their output while it exists, those of removed outputs move to
+// the first output and new outputs show the first hidden workspace. Only
+// the workspaces whose output rectangle changed are laid out again
+
+void output_update()
+{
+	output_t old[MAX_OUTPUTS];
+	uint8_t old_count = output_count;
+	uint8_t shown[LENGTH( workspaces )], taken[MAX_OUTPUTS] = { 0 };
+	rect_t before[LENGTH( workspaces )];
+
+	memcpy( old, outputs, sizeof( old ) );
+
+	for( int i = 0; i < LENGTH( workspaces ); i++ )
+	{
+		before[i] = AREA( i );
+		shown[i]  = old_count && outputs[monitors[i]].workspace == i;
+	}
+
+	output_count = 0;
+
+#ifdef RANDR
+	XRRScreenResources *res = XRRGetScreenResourcesCurrent( display, root );
+
+	for( int i = 0; res && i < res->noutput && output_count < MAX_OUTPUTS; i++ )
+	{
+		XRROutputInfo *info = XRRGetOutputInfo( display, res, res->outputs[i] );
+		XRRCrtcInfo *crtc = info && info->connection == RR_Connected && info->crtc ? 
+		                    XRRGetCrtcInfo( display, res, info->crtc ) : NULL;
+
+		if( crtc && crtc->width && crtc->height )
+		{
+			rect_t r = { crtc->x, crtc->y, crtc->width, crtc->height };
+			int j = 0;
+
+			// Clones share a rectangle and count as one output
+			while( j < output_count && memcmp( &outputs[j].r, &r, sizeof( r ) ) )
+				j++;
+
+			if( j == output_count )
+				outputs[output_count++] = ( output_t ) { res->outputs[i], r, 0 };
+		}
+
+		if( crtc ) XRRFreeCrtcInfo( crtc );
+		if( info ) XRRFreeOutputInfo( info );
+	}
+
+	if( res )
+		XRRFreeScreenResources( res );
+#endif
+
+	sw = XDisplayWidth( display, DefaultScreen( display ) );
+	sh = XDisplayHeight( display, DefaultScreen( display ) );
+
+	if( !output_count )
+		outputs[output_count++] = ( output_t ) { None, { 0, 0, sw, sh }, 0 };
+
+	// Sorted by x then y, so that index order follows the screen
+	for( int i = 1; i < output_count; i++ )
+	{
+		output_t o = outputs[i];
+		int j = i;
+
+		for( ; j > 0 && ( outputs[j - 1].r.x > o.r.x || 
+		                ( outputs[j - 1].r.x == o.r.x && outputs[j - 1].r.y > o.r.y ) ); j-- )
+			outputs[j] = outputs[j - 1];
+
+		outputs[j] = o;
+	}
+
+	output_index();
+
+	// Carry every workspace over to the new index of its output, or at
+	// startup deal the workspaces out over the outputs
+	for( int i = 0; i < LENGTH( workspaces ); i++ )
+	{
+		int j = 0;
+
+		if( !old_count )
+		{
+			j = i % output_count;
+			shown[i] = i < output_count;
+		}
+		else
+			while( j < output_count && outputs[j].id != old[monitors[i]].id )
+				j++;
+
+		if( j == output_count )
+		{
+			j = 0;
+			shown[i] = 0;
+		}
+
+		monitors[i] = j;
+
+		if( shown[i] )
+		{
+			outputs[j].workspace = i;
+			taken[j] = 1;
+		}
+	}
+
+	for( int j = 0; j < output_count; j++ )
+		for( int i = 0; !taken[j] && i < LENGTH( workspaces ); i++ )
+			if( outputs[monitors[i]].workspace != i || !taken[monitors[i]] )
+			{
+				monitors[i] = j;
+				outputs[j].workspace = i;
+				taken[j] = 1;
+			}
+
+	workspace = outputs[monitors[workspace]].workspace;
+
+	for( int i = 0; i < LENGTH( workspaces ); i++ )
+	{
+		uint8_t visible = outputs[monitors[i]].workspace == i;
+		rect_t r = AREA( i );
+
+		if( old_count && visible != shown[i] )
+			workspace_show( i, visible );
+
+		if( !memcmp( &r, &before[i], sizeof( r ) ) )
+			continue;
+
+	#ifdef CONTAINERS
+		XMoveResizeWindow( display, containers[i], r.x, r.y, r.w, r.h );
+	#endif
+
+		// Floating windows keep their place relative to the output, tiled
+		// windows are laid out again
+		client_t *c = workspaces[i];
+
+		if( c && old_count )
+			do
+			{
+				if( c->floating || !layouts[i] )
+					window_move_resize( c, layout_move( 
+						r, 
+						( rect_t ) { 
+							c->x + r.x - before[i].x, c->y + r.y - before[i].y, c->w, c->h 
+						}, 
+						0, 
+						0 
+					) );
+			}
+			while( ( c = c->next ) != workspaces[i] );
+
+		workspace_tile( i );
+	}
+}
+
+
+// output_index()
+//
+// Cut the screen into slabs at the vertical edges of the outputs, and list
+// the outputs crossing each slab from top to bottom, for output_at()
+
+void output_index()
+{
+	edge_count = 0;
+
+	// The distinct left and right edges, sorted
+	for( int i = 0; i < output_count * 2; i++ )
+	{
+		rect_t r = outputs[i / 2].r;
+		int32_t x = i % 2 ? r.x + ( int32_t ) r.w : r.x;
+		int j = edge_count;
+
+		for( ; j > 0 && slab_edges[j - 1] > x; j-- );
+
+		if( j > 0 && slab_edges[j - 1] == x )
+			continue;
+
+		memmove( &slab_edges[j + 1], &slab_edges[j], ( edge_count - j ) * sizeof( *slab_edges ) );
+		slab_edges[j] = x;
+		edge_count++;
+	}
+
+	// Slab k runs from edge k to edge k + 1, an output either spans it
+	// whole or misses it
+	for( int k = 0; k + 1 < edge_count; k++ )
+	{
+		span_t *spans = slabs[k];
+		uint8_t n = 0;
+
+		for( int i = 0; i < output_count; i++ )
+		{
+			rect_t r = outputs[i].r;
+
+			if( r.x > slab_edges[k] || r.x + ( int32_t ) r.w < slab_edges[k + 1] )
+				continue;
+
+			span_t span = { r.y, r.y + ( int32_t ) r.h, i };
+			int j = n++;
+
+			for( ; j > 0 && spans[j - 1].top > span.top; j-- )
+				spans[j] = spans[j - 1];
+
+			spans[j] = span;
+		}
+
+		// Overlaps go to the output starting higher
+		uint8_t m = 0;
+
+		for( int j = 0; j < n; j++ )
+		{
+			if( m && spans[j].top < spans[m - 1].bottom )
+				spans[j].top = spans[m - 1].bottom;
+
+			if( spans[j].top < spans[j].bottom )
+				spans[m++] = spans[j];
+		}
+
+		span_counts[k] = m;
+	}
+}
+
+
+// output_at()
+//
+// The output holding a point, found by a binary search over the slabs and
+// another over the spans of the slab. A point on no output belongs to the
+// first
+//
+// x, y - The point
+
+uint8_t output_at( int32_t x, int32_t y )
+{
+	int lo = 0, hi = edge_count;
+
+	// The last edge at or left of x starts the slab
+	while( lo < hi )
+	{
+		int mid = ( lo + hi ) / 2;
+
+		if( slab_edges[mid] <= x )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if( lo == 0 || lo == edge_count )
+		return 0;
+
+	span_t const *spans = slabs[lo - 1];
+	int k = 0, n = span_counts[lo - 1];
+
+	// The last span starting at or above y
+	while( k < n )
+	{
+		int mid = ( k + n ) / 2;
+
+		if( spans[mid].top <= y )
+			k = mid + 1;
+		else
+			n = mid;
+	}
+
+	return k && y < spans[k - 1].bottom ? spans[k - 1].output : 0;
+}
+
+
+#ifdef RANDR
+// screen_change()
+//
+// Follow outputs being plugged, unplugged or reconfigured
+//
+// e - The RRScreenChangeNotify XEvent
+
+void screen_change( XEvent *e )
+{
+	XRRUpdateConfiguration( e );
+	output_update();
+}
+#endif
+
+
+#ifdef OUTLINE
+
+// outline_setup()
+//
+// Create the GC the outline is inverted with
+
+void outline_setup()
+{
+	outline_gc = XCreateGC( 
+		display, 
+		root, 
+		GCFunction | GCForeground | GCLineWidth | GCSubwindowMode, 
+		&(XGCValues) {
+			.function       = GXxor,
+			.foreground     = WhitePixel( display, DefaultScreen( display ) ),
+			.line_width     = 2,
+			.subwindow_mode = IncludeInferiors
+		}
+	);
+}
+
+
+// outline_draw()
+//
+// Erase the resize outline last drawn and draw the next one. The outline is
+// inverted onto the root, over every window, so drawing it twice erases it.
+// The server is grabbed while an outline is up, as a client painting under
+// it would leave it half erased
+//
+// r    - The outline, border included
+// show - Whether to draw r, or only erase the last outline
+
+void outline_draw( rect_t r, uint8_t show )
+{
+	static rect_t   last;
+	static uint8_t  shown;
+
+	if( shown )
+		XDrawRectangle( display, root, outline_gc, last.x, last.y, last.w - 1, last.h - 1 );
+	else if( show )
+		XGrabServer( display );
+
+	if( show )
+		XDrawRectangle( display, root, outline_gc, r.x, r.y, r.w - 1, r.h - 1 );
+	else if( shown )
+		XUngrabServer( display );
+
+	last  = r;
+	shown = show;
+}
+
+#endif
+
+
+#ifdef OVERVIEW
+
+////////////////////////////////////////////////////////////////////////////////
+// OVERVIEW
+////////////////////////////////////////////////////////////////////////////////
+
+
+// overview()
+//
+// Open or close the overview, a grid of every workspace's thumbnail over the
+// current output. Only the thumbnails of shown workspaces that were damaged
+// since they were rendered are rendered again, the rest come from the cache
+//
+// a - Unused parameter
+
+void overview( argument_t const a )
+{
+	if( overview_window )
+	{
+		overview_close();
+		return;
+	}
+
+	if( damage_event < 0 )
+		return;
+
+	for( int i = 0; i < LENGTH( workspaces ); i++ )
+		if( thumbnails[i].dirty && outputs[monitors[i]].workspace == i )
+			thumbnail_render( i );
+
+	overview_area   = AREA( workspace );
+	overview_window = XCreateWindow( 
+		display, 
+		root, 
+		overview_area.x, 
+		overview_area.y, 
+		overview_area.w, 
+		overview_area.h, 
+		0, 
+		CopyFromParent, 
+		InputOutput, 
+		CopyFromParent,
+		CWOverrideRedirect | CWBackPixel | CWEventMask,
+		&(XSetWindowAttributes) {
+			.override_redirect = True,
+			.background_pixel  = BlackPixel( display, DefaultScreen( display ) ),
+			.event_mask        = ButtonPressMask | ExposureMask
+		}
+	);
+	overview_picture = XRenderCreatePicture( 
+		display, 
+		overview_window, 
+		XRenderFindVisualFormat( display, DefaultVisual( display, DefaultScreen( display ) ) ), 
+		0, 
+		NULL 
+	);
+
+	// Drawn once the first Expose arrives
+	XMapRaised( display, overview_window );
+}
+
+
+// overview_close()
+//
+// Destroy the overview window, the thumbnails stay cached
+
+void overview_close()
+{
+	XRenderFreePicture( display, overview_picture );
+	XDestroyWindow( display, overview_window );
+	overview_window = None;
+}
+
+
+// overview_draw()
+//
+// Copy every cached thumbnail into its cell of the overview, workspace i in
+// row i / OVERVIEW_SCALE and column i % OVERVIEW_SCALE
+
+void overview_draw()
+{
+	uint32_t cw = overview_area.w / OVERVIEW_SCALE;
+	uint32_t ch = overview_area.h / OVERVIEW_SCALE;
+
+	for( int i = 0; i < LENGTH( thumbnails ); i++ )
+	{
+		thumbnail_t *t = &thumbnails[i];
+
+		if( !t->picture )
+			continue;
+
+		// Thumbnails of another output's workspaces may differ in size
+		XRenderComposite( 
+			display, 
+			PictOpSrc, 
+			t->picture, 
+			None, 
+			overview_picture, 
+			0, 
+			0, 
+			0, 
+			0, 
+			i % OVERVIEW_SCALE * cw + ( cw - MIN( t->w, cw ) ) / 2, 
+			i / OVERVIEW_SCALE * ch + ( ch - MIN( t->h, ch ) ) / 2, 
+			MIN( t->w, cw ), 
+			MIN( t->h, ch ) 
+		);
+	}
+}
+
+
+// overview_select()
+//
+// Close the overview and switch to the workspace whose cell was clicked
+//
+// x, y - The click relative to the overview
+
+void overview_select( int32_t x, int32_t y )
+{
+	uint32_t i = y / MAX( overview_area.h / OVERVIEW_SCALE, 1 ) * OVERVIEW_SCALE + 
+	             x / MAX( overview_area.w / OVERVIEW_SCALE, 1 );
+
+	overview_close();
+
+	if( i < LENGTH( workspaces ) )
+		to_workspace( ( argument_t ) { .x = i } );
+}
+
+
+// thumbnail_render()
+//
+// Render the thumbnail of a shown workspace, its windows scaled down from the
+// least recently focused up, and subtract their damage so that the next
+// change to each window is reported again
+//
+// i - The workspace
+
+void thumbnail_render( uint8_t i )
+{
+	thumbnail_t *t = &thumbnails[i];
+	rect_t s = AREA( i );
+	uint32_t w = MAX( s.w / OVERVIEW_SCALE, 1 ), h = MAX( s.h / OVERVIEW_SCALE, 1 );
+	int screen = DefaultScreen( display );
+
+	if( t->w != w || t->h != h )
+	{
+		if( t->picture )
+		{
+			XRenderFreePicture( display, t->picture );
+			XFreePixmap( display, t->pixmap );
+		}
+
+		t->w       = w;
+		t->h       = h;
+		t->pixmap  = XCreatePixmap( display, root, w, h, DefaultDepth( display, screen ) );
+		t->picture = XRenderCreatePicture( 
+			display, 
+			t->pixmap, 
+			XRenderFindVisualFormat( display, DefaultVisual( display, screen ) ), 
+			0, 
+			NULL 
+		);
+	}
+
+	XRenderFillRectangle( display, PictOpSrc, t->picture, 
+	                      &(XRenderColor){ 0, 0, 0, 0xffff }, 0, 0, w, h );
+
+	for( client_t *c = workspaces[i] ? workspaces[i]->prev : NULL; c; c = c->prev )
+	{
+		if( !c->picture )
+		{
+			XWindowAttributes wa;
+			XRenderPictFormat *f;
+
+			// The format is read once for the life of the window
+			if( !XGetWindowAttributes( display, c->window, &wa ) || 
+			    !( f = XRenderFindVisualFormat( display, wa.visual ) ) )
+				goto next;
+
+			c->picture = XRenderCreatePicture( 
+				display, 
+				c->window, 
+				f, 
+				CPSubwindowMode, 
+				&(XRenderPictureAttributes){ .subwindow_mode = IncludeInferiors } 
+			);
+
+			XRenderSetPictureFilter( display, c->picture, FilterBilinear, NULL, 0 );
+			XRenderSetPictureTransform( display, c->picture, &(XTransform) {{
+				{ XDoubleToFixed( OVERVIEW_SCALE ), 0, 0 },
+				{ 0, XDoubleToFixed( OVERVIEW_SCALE ), 0 },
+				{ 0, 0, XDoubleToFixed( 1 ) }
+			}} );
+		}
+
+		XRenderComposite( 
+			display, 
+			PictOpOver, 
+			c->picture, 
+			None, 
+			t->picture, 
+			0, 
+			0, 
+			0, 
+			0, 
+			( c->x - s.x ) / OVERVIEW_SCALE, 
+			( c->y - s.y ) / OVERVIEW_SCALE, 
+			c->w / OVERVIEW_SCALE, 
+			c->h / OVERVIEW_SCALE 
+		);
+
+	next:
+		if( c->damage )
+			XDamageSubtract( display, c->damage, None, None );
+
+		if( c == workspaces[i] )
+			break;
+	}
+
+	t->dirty = 0;
+	thumbnails_rendered++;
+}
+
+
+// thumbnail_watch()
+//
+// Have the first change to a client's window reported, the rest are folded
+// into the same damage until its thumbnail is rendered
+//
+// c - The client
+
+void thumbnail_watch( client_t *c )
+{
+	if( damage_event >= 0 )
+		c->damage = XDamageCreate( display, c->window, XDamageReportNonEmpty );
+}
+
+
+// thumbnail_forget()
+//
+// Free the damage and picture of a client as it stops being managed, both
+// may already be gone with the window
+//
+// c - The client
+
+void thumbnail_forget( client_t *c )
+{
+	if( c->damage )
+		XDamageDestroy( display, c->damage );
+
+	if( c->picture )
+		XRenderFreePicture( display, c->picture );
+}
+
+
+// damage_notify()
+//
+// Mark the thumbnail of a damaged window's workspace for rendering. The
+// damage is left in place, so the window reports nothing more until then
+//
+// e - The XEvent
+
+void damage_notify( XEvent *e )
+{
+	client_t *c = window_find( ( ( XDamageNotifyEvent * ) e )->drawable );
+
+	damages++;
+
+	if( c )
+		thumbnails[c->workspace].dirty = 1;
+}
+
+#endif // OVERVIEW
+
+
+////////////////////////////////////////////////////////////////////////////////
+// PROCESS
+////////////////////////////////////////////////////////////////////////////////
+
+
+// process_path()
+//
+// Resolve a command through $PATH, remembering the result. Commands holding
+// a slash are used as they are
+//
+// name    - The command
+// refresh - Whether to drop a remembered result and search again
+
+char const *process_path( char const *name, uint8_t refresh )
+{
+	char candidate[PATH_MAX];
+	path_t *p = NULL;
+
+	if( strchr( name, '/' ) )
+		return refresh ? NULL : name;
+
+	for( int i = 0; i < PATH_CACHE && paths[i].name; i++ )
+		if( !strcmp( paths[i].name, name ) )
+		{
+			if( !refresh )
+				return paths[i].path;
+
+			p = &paths[i];
+			break;
+		}
+
+	char const *dirs = getenv( "PATH" );
+
+	if( !dirs )
+		dirs = "/usr/local/bin:/usr/bin:/bin";
+
+	while( *dirs )
+	{
+		size_t n = strcspn( dirs, ":" );
+
+		if( snprintf( candidate, sizeof( candidate ), "%.*s/%s", 
+		              ( int ) n, n ? dirs : ".", name ) < sizeof( candidate ) &&
+		    !access( candidate, X_OK ) )
+		{
+			// The oldest result makes room
+			if( !p )
+			{
+				p = &paths[path_next++ % PATH_CACHE];
+				free( p->name );
+				p->name = strdup( name );
+			}
+
+			free( p->path );
+			p->path = strdup( candidate );
+
+			return p->path;
+		}
+
+		dirs += n + ( dirs[n] == ':' );
+	}
+
+	return NULL;
+}
+
+
+// process_add()
+//
+// Track a spawned child until it is reaped
+//
+// pid  - The child
+// name - The command it runs
+
+void process_add( pid_t pid, char const *name )
+{
+	for( int i = 0; i < MAX_PROCESSES; i++ )
+	{
+		if( processes[i].pid )
+			continue;
+
+		processes[i] = ( process_t ) { .pid = pid, .start = monotonic() };
+		snprintf( processes[i].name, sizeof( processes[i].name ), "%s", name );
+		return;
+	}
+}
+
+
+// process_reap()
+//
+// Reap every exited child, reporting those that failed
+
+void process_reap()
+{
+	pid_t pid;
+	int status;
+
+	while( ( pid = waitpid( -1, &status, WNOHANG ) ) > 0 )
+		for( int i = 0; i < MAX_PROCESSES; i++ )
+		{
+			if( processes[i].pid != pid )
+				continue;
+
+			if( WIFSIGNALED( status ) )
+				fprintf( stderr, "EXIT %s %d signal %d\n", processes[i].name, pid, WTERMSIG( status ) );
+			else if( WEXITSTATUS( status ) )
+				fprintf( stderr, "EXIT %s %d code %d\n", processes[i].name, pid, WEXITSTATUS( status ) );
+
+			processes[i].pid = 0;
+			break;
+		}
+}
+
+
+// process_mapped()
+//
+// Match a newly mapped window to the child that spawned it, recording the
+// time from spawn to map. The window's _NET_WM_PID is matched first, as
+// launchers such as dmenu_run never map a window of their own, then the
+// oldest child still waiting for a window. The property is only read while
+// a child is waiting
+//
+// window - The window
+
+void process_mapped( Window window )
+{
+	unsigned char *data = NULL;
+	uint64_t now = monotonic();
+	uint64_t timeout = SPAWN_TIMEOUT * 1000000ull;
+	process_t *p = NULL;
+
+	for( int i = 0; i < MAX_PROCESSES; i++ )
+	{
+		process_t *q = &processes[i];
+
+		if( !q->pid || q->mapped || now - q->start > timeout )
+			continue;
+
+		if( !p || q->start < p->start )
+			p = q;
+	}
+
+	// Most windows are mapped with no child waiting, and cost no round trip
+	if( !p )
+		return;
+
+	if( XGetWindowProperty( display, window, atoms[NET_WM_PID], 0, 1, False, XA_CARDINAL, 
+	                        &(Atom){0}, &(int){0}, &(unsigned long){0}, 
+	                        &(unsigned long){0}, &data ) == Success && data )
+	{
+		pid_t pid = *( unsigned long * ) data;
+
+		XFree( data );
+
+		for( int i = 0; i < MAX_PROCESSES; i++ )
+		{
+			process_t *q = &processes[i];
+
+			if( q->pid == pid && !q->mapped && now - q->start <= timeout )
+			{
+				p = q;
+				break;
+			}
+		}
+	}
+
+	p->mapped = 1;
+	histogram_add( &spawns, now - p->start );
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// RESTART
+////////////////////////////////////////////////////////////////////////////////
+
+
+// restart()
+//
+// Replace the running window manager with the binary on disk, found as it
+// was started, keeping every client where it is. The clients, focus order
+// and geometry are written to a memfd inherited across exec. Under
+// CONTAINERS the containers alone are kept alive past the old connection so
+// no client is reparented or unmapped. On failure the window manager keeps
+// running
+//
+// a - Unused parameter
+
+void restart( argument_t const a )
+{
+	snapshot_t h = { 
+		.magic     = SNAPSHOT_MAGIC, 
+		.count     = client_count, 
+		.orders    = orders, 
+		.time      = monotonic(),
+		.workspace = workspace 
+	};
+	char fd_name[16];
+	int fd = memfd_create( "wm-snapshot", 0 );
+
+	if( fd < 0 || !arguments )
+	{
+		fprintf( stderr, "RESTART %s\n", strerror( errno ) );
+		return;
+	}
+
+	for( int i = 0; i < LENGTH( workspaces ); i++ )
+	{
+		h.layouts[i]  = layouts[i];
+		h.monitors[i] = monitors[i];
+		h.shown[i]    = outputs[monitors[i]].workspace == i;
+	#ifdef CONTAINERS
+		h.containers[i] = containers[i];
+	#endif
+	}
+
+	snapshot_client_t *list = malloc( client_count * sizeof( *list ) + 1 );
+	uint32_t n = 0;
+
+	for( int i = 0; list && i < LENGTH( workspaces ); i++ )
+	{
+		client_t *c = workspaces[i];
+
+		if( c )
+			do list[n++] = ( snapshot_client_t ) { 
+				c->window, c->x, c->y, c->w, c->h, c->border, c->order, c->workspace, c->floating,
+				c->fullscreen
+			};
+			while( ( c = c->next ) != workspaces[i] );
+	}
+
+	if( !list || 
+	    write( fd, &h, sizeof( h ) ) != sizeof( h ) || 
+	    write( fd, list, n * sizeof( *list ) ) != n * sizeof( *list ) ||
+	    lseek( fd, 0, SEEK_SET ) )
+	{
+		fprintf( stderr, "RESTART %s\n", strerror( errno ) );
+		free( list );
+		close( fd );
+		return;
+	}
+
+	free( list );
+	batch_flush( 0 );
+
+#ifdef CONTAINERS
+	restart_release();
+	XSetCloseDownMode( display, RetainPermanent );
+#endif
+	XSync( display, False );
+
+	snprintf( fd_name, sizeof( fd_name ), "%d", fd );
+	setenv( "WM_SNAPSHOT", fd_name, 1 );
+	execvp( arguments[0], arguments );
+
+	// The image already running, when the binary on disk cannot be run
+	execv( "/proc/self/exe", arguments );
+
+	fprintf( stderr, "RESTART %s\n", strerror( errno ) );
+	unsetenv( "WM_SNAPSHOT" );
+	close( fd );
+#ifdef CONTAINERS
+	XSetCloseDownMode( display, DestroyAll );
+	restart_reclaim();
+#endif
+}
+
+
+#ifdef CONTAINERS
+// restart_release()
+//
+// Free every resource of the connection but the containers, as
+// RetainPermanent keeps all of them past it. The next instance makes its
+// own, the thumbnails and client pictures are caches made again on use
+
+void restart_release()
+{
+	XDestroyWindow( display, check );
+#ifdef OUTLINE
+	XFreeGC( display, outline_gc );
+#endif
+#ifdef OVERVIEW
+	if( overview_window )
+		overview_close();
+
+	for( int i = 0; i < LENGTH( workspaces ); i++ )
+	{
+		thumbnail_t *t = &thumbnails[i];
+
+		if( t->picture )
+		{
+			XRenderFreePicture( display, t->picture );
+			XFreePixmap( display, t->pixmap );
+		}
+
+		*t = ( thumbnail_t ) { .dirty = 1 };
+
+		client_t *c = workspaces[i];
+
+		if( c )
+			do
+			{
+				thumbnail_forget( c );
+				c->damage  = None;
+				c->picture = None;
+			}
+			while( ( c = c->next ) != workspaces[i] );
+	}
+#endif
+}
+
+
+// restart_reclaim()
+//
+// Make again what restart_release() freed, once the exec failed
+
+void restart_reclaim()
+{
+	ewmh_setup();
+#ifdef OUTLINE
+	outline_setup();
+#endif
+#ifdef OVERVIEW
+	for( int i = 0; i < LENGTH( workspaces ); i++ )
+	{
+		client_t *c = workspaces[i];
+
+		if( c )
+			do thumbnail_watch( c );
+			while( ( c = c->next ) != workspaces[i] );
+	}
+#endif
+}
+#endif // CONTAINERS
+
+
+// snapshot_open()
+//
+// Read the header of the snapshot left by restart(), if there is one
+//
+// h - Set to the header
+//
+// Returns the memfd positioned at the clients, or -1
+
+int snapshot_open( snapshot_t *h )
+{
+	char const *name = getenv( "WM_SNAPSHOT" );
+	int fd = name ? atoi( name ) : -1;
+
+	// Children spawned later must not see it
+	unsetenv( "WM_SNAPSHOT" );
+
+	if( fd < 0 )
+		return -1;
+
+	if( read( fd, h, sizeof( *h ) ) != sizeof( *h ) || h->magic != SNAPSHOT_MAGIC )
+	{
+		close( fd );
+		return -1;
+	}
+
+	return fd;
+}
+
+
+// snapshot_restore()
+//
+// Rebuild the clients from a snapshot, taking them over without moving,
+// mapping or unmapping any of them. Event selections and the save set
+// belonged to the old connection and are made again. window_adopt() then
+// drops the windows lost before the selections were made, and focuses the
+// current workspace
+//
+// fd - The memfd from snapshot_open()
+// h  - The header
+
+void snapshot_restore( int fd, snapshot_t const *h )
+{
+	snapshot_client_t *list = malloc( h->count * sizeof( *list ) + 1 );
+	uint32_t n = 0;
+
+	if( list )
+		n = MAX( read( fd, list, h->count * sizeof( *list ) ), 0 ) / sizeof( *list );
+
+	close( fd );
+
+	for( int i = 0; i < LENGTH( workspaces ); i++ )
+	{
+		layouts[i] = h->layouts[i] < LAYOUT_COUNT ? h->layouts[i] : LAYOUT;
+
+		if( h->monitors[i] < output_count )
+			monitors[i] = h->monitors[i];
+	}
+
+	for( int i = 0; i < LENGTH( workspaces ); i++ )
+		if( h->shown[i] )
+			outputs[monitors[i]].workspace = i;
+
+	workspace = outputs[monitors[h->workspace % LENGTH( workspaces )]].workspace;
+	orders    = h->orders;
+
+	// Linking at the front, the last of a workspace's clients goes first
+	for( uint32_t i = n; i-- > 0; )
+	{
+		snapshot_client_t *s = &list[i];
+		if( s->workspace >= LENGTH( workspaces ) || window_find( s->window ) )
+			continue;
+
+		client_t *c = client_alloc();
+
+		if( !c )
+			continue;
+
+		*c = ( client_t ) { 
+			.window   = s->window, 
+			.x        = s->x, 
+			.y        = s->y, 
+			.w        = s->w, 
+			.h        = s->h, 
+			.border   = s->border,
+			.order      = s->order, 
+			.floating   = s->floating,
+			.fullscreen = s->fullscreen
+		};
+
+		client_index( c );
+		client_link( c, s->workspace );
+		ewmh_client_add( c->window );
+	#ifdef OVERVIEW
+		thumbnail_watch( c );
+	#endif
+		c->tile = layout_tile( AREA( s->workspace ), ( rect_t ) { c->x, c->y, c->w, c->h } );
+
+		XSelectInput( display, c->window, StructureNotifyMask | EnterWindowMask | PropertyChangeMask );
+	#ifdef CONTAINERS
+		XAddToSaveSet( display, c->window );
+	#endif
+	}
+
+	free( list );
+
+	#ifdef DEBUG
+		fprintf( stderr, "RESTART %u clients %.3f ms\n", n, ( monotonic() - h->time ) / 1e6 );
+	#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// CONFIG
+////////////////////////////////////////////////////////////////////////////////
+
+
+#define MOD_CONFIGURED ( 1 << 15 ) // Stands for the mod a file sets, wherever it sets it
+
+
+// config_init()
+//
+// Set a configuration to the constants, with no key bindings yet
+//
+// c - The configuration
+
+void config_init( config_t *c )
+{
+	c->border    = BORDER;
+	c->gap       = GAP;
+	c->mod       = MOD;
+	c->terminal  = terminal;
+	c->menu      = menu;
+	c->key_count = 0;
+	c->used      = 0;
+	c->rule_fields = 0;
+
+	memset( c->rules, 0, sizeof( c->rules ) );
+
+#ifdef SNAP
+	c->snap = SNAP_PIXELS;
+#else
+	c->snap = 0;
+#endif
+}
+
+
+// config_finish()
+//
+// Append KEYS behind the bindings already read, with MOD, terminal and menu
+// replaced by those configured
+//
+// c - The configuration
+//
+// Returns NULL, or the error when the bindings do not fit
+
+char const *config_finish( config_t *c )
+{
+	if( c->key_count + LENGTH( KEYS ) > MAX_KEYS )
+		return "too many bindings";
+
+	for( int i = 0; i < LENGTH( KEYS ); i++ )
+	{
+		key_input_t k = KEYS[i];
+
+		if( k.mod & MOD )
+			k.mod = ( k.mod & ~MOD ) | MOD_CONFIGURED;
+
+		if( k.a.p == terminal )
+			k.a.p = c->terminal;
+		else if( k.a.p == menu )
+			k.a.p = c->menu;
+
+		c->keys[c->key_count++] = k;
+	}
+
+	for( uint32_t i = 0; i < c->key_count; i++ )
+		if( c->keys[i].mod & MOD_CONFIGURED )
+			c->keys[i].mod = ( c->keys[i].mod & ~MOD_CONFIGURED ) | c->mod;
+
+	return NULL;
+}
+
+
+// rule_hash()
+//
+// Hash a rule's field and value, FNV-1a
+//
+// field - The rule_field_t
+// value - The string matched
+
+uint32_t rule_hash( uint8_t field, char const *value )
+{
+	uint32_t h = 2166136261u ^ field;
+
+	while( *value )
+		h = ( h ^ ( uint8_t ) *value++ ) * 16777619u;
+
+	return h;
+}
+
+
+// rule_find()
+//
+// Find the rule for a window by its title, then instance, then class. Only
+// the properties some rule matches on are read, a window is matched without
+// a round trip when there are no rules
+//
+// window - The Window
+//
+// Returns the rule, or NULL when none matches
+
+rule_t const *rule_find( Window window )
+{
+	XClassHint hint = { 0 };
+	char *title = NULL;
+	char const *values[RULE_COUNT] = { 0 };
+	rule_t const *found = NULL;
+
+	if( !config->rule_fields )
+		return NULL;
+
+	if( config->rule_fields & ( 1 << RULE_INSTANCE | 1 << RULE_CLASS ) && 
+	    XGetClassHint( display, window, &hint ) )
+	{
+		values[RULE_INSTANCE] = hint.res_name;
+		values[RULE_CLASS]    = hint.res_class;
+	}
+
+	if( config->rule_fields & 1 << RULE_TITLE && XFetchName( display, window, &title ) )
+		values[RULE_TITLE] = title;
+
+	for( uint8_t f = 0; f < RULE_COUNT && !found; f++ )
+	{
+		if( !values[f] || !( config->rule_fields & 1 << f ) )
+			continue;
+
+		uint32_t h = rule_hash( f, values[f] );
+
+		for( rule_t const *r = config->rules[h & ( RULE_BUCKETS - 1 )]; r; r = r->next )
+			if( r->hash == h && r->field == f && !strcmp( r->value, values[f] ) )
+			{
+				found = r;
+				break;
+			}
+	}
+
+	if( found )
+		rules_matched++;
+
+	XFree( hint.res_name );
+	XFree( hint.res_class );
+	XFree( title );
+
+	return found;
+}
+
+
+#ifdef CONFIG
+
+// config_alloc()
+//
+// Allocate from the arena of a configuration
+//
+// c      - The configuration
+// length - The bytes wanted
+//
+// Returns the memory, pointer aligned, or NULL once the arena is full
+
+static void *config_alloc( config_t *c, size_t length )
+{
+	uint32_t at = ( c->used + sizeof( void * ) - 1 ) & ~( sizeof( void * ) - 1 );
+
+	if( at + length > sizeof( c->arena ) )
+		return NULL;
+
+	c->used = at + length;
+
+	return c->arena + at;
+}
+
+
+// config_command()
+//
+// Copy the rest of a line into the arena as a command for run()
+//
+// c     - The configuration
+// first - The first word of the command, already taken from the line
+// save  - The strtok_r() state of the line
+//
+// Returns the NULL terminated command, or NULL when empty or out of space
+
+static char const **config_command( config_t *c, char *first, char **save )
+{
+	char *argv[32] = { first };
+	int n = !!first;
+
+	while( n && n < LENGTH( argv ) - 1 && ( argv[n] = strtok_r( NULL, " \t\n", save ) ) )
+		n++;
+
+	char const **command = config_alloc( c, ( n + 1 ) * sizeof( char * ) );
+
+	if( !n || !command )
+		return NULL;
+
+	for( int i = 0; i < n; i++ )
+	{
+		size_t length = strlen( argv[i] ) + 1;
+
+		if( !( command[i] = config_alloc( c, length ) ) )
+			return NULL;
+
+		memcpy( ( char * ) command[i], argv[i], length );
+	}
+
+	command[n] = NULL;
+
+	return command;
+}
+
+
+// config_modifier()
+//
+// Look up a modifier by name
+//
+// name - Shift, Control, Alt, Super, Mod1 to Mod5, or Mod for the mod
+//
+// Returns the mask, 0 when unknown
+
+static uint32_t config_modifier( char const *name )
+{
+	static struct { char const *name; uint32_t mask; } const names[] = {
+		{ "Shift",   ShiftMask },
+		{ "Control", ControlMask },
+		{ "Ctrl",    ControlMask },
+		{ "Alt",     Mod1Mask },
+		{ "Super",   Mod4Mask },
+		{ "Mod1",    Mod1Mask },
+		{ "Mod2",    Mod2Mask },
+		{ "Mod3",    Mod3Mask },
+		{ "Mod4",    Mod4Mask },
+		{ "Mod5",    Mod5Mask },
+		{ "Mod",     MOD_CONFIGURED },
+	};
+
+	for( int i = 0; i < LENGTH( names ); i++ )
+		if( !strcmp( name, names[i].name ) )
+			return names[i].mask;
+
+	return 0;
+}
+
+
+// config_read()
+//
+// Read the configuration file into a new configuration. A file that does not
+// parse is reported with the line at fault and leaves nothing changed
+//
+// Returns the configuration, or NULL when there is no file or it has an error
+
+config_t *config_read()
+{
+	FILE *f = fopen( config_path, "r" );
+	config_t *c;
+	char line[1024];
+	char const *error = NULL;
+	uint32_t n = 0;
+
+	if( !f )
+	{
+		if( errno != ENOENT )
+			perror( config_path );
+
+		return NULL;
+	}
+
+	if( !( c = malloc( sizeof( config_t ) ) ) )
+	{
+		fclose( f );
+		return NULL;
+	}
+
+	config_init( c );
+
+	while( !error && fgets( line, sizeof( line ), f ) )
+	{
+		n++;
+		error = config_line( c, line );
+	}
+
+	fclose( f );
+
+	if( !error && ( error = config_finish( c ) ) )
+		n = 0;
+
+	if( error )
+	{
+		fprintf( stderr, "CONFIG %s:%u: %s\n", config_path, n, error );
+		free( c );
+		return NULL;
+	}
+
+	return c;
+}
+
+
+// config_line()
+//
+// Parse one line of the configuration file, one of
+//
+//   border <pixels>
+//   gap <pixels>
+//   snap <pixels>
+//   mod <modifier>
+//   terminal <command...>
+//   menu <command...>
+//   bind <modifier+...+key> <action> [argument...]
+//   unbind <modifier+...+key>
+//   rule <class|instance|title> <value> [workspace <n>] [floating] [tiled]
+//        [geometry <x> <y> <w> <h>] [nofocus]
+//
+// Blank lines and lines starting with # are skipped
+//
+// c    - The configuration
+// line - The line, changed by the parse
+//
+// Returns NULL, or the error
+
+char const *config_line( config_t *c, char *line )
+{
+	char *save, *end;
+	char *name  = strtok_r( line, " \t\n", &save );
+	char *value = strtok_r( NULL, " \t\n", &save );
+
+	if( !name || name[0] == '#' )
+		return NULL;
+
+	if( !value )
+		return "missing value";
+
+	if( !strcmp( name, "border" ) || !strcmp( name, "gap" ) || !strcmp( name, "snap" ) )
+	{
+		unsigned long v = strtoul( value, &end, 0 );
+
+		if( *end || v > 1000 )
+			return "bad number";
+
+		*( name[0] == 'b' ? &c->border : name[0] == 'g' ? &c->gap : &c->snap ) = v;
+	}
+	else if( !strcmp( name, "mod" ) )
+	{
+		uint32_t mask = config_modifier( value );
+
+		if( !mask || mask == MOD_CONFIGURED )
+			return "bad modifier";
+
+		c->mod = mask;
+	}
+	else if( !strcmp( name, "terminal" ) || !strcmp( name, "menu" ) )
+	{
+		char const **command = config_command( c, value, &save );
+
+		if( !command )
+			return "bad command";
+
+		*( name[0] == 't' ? &c->terminal : &c->menu ) = command;
+	}
+	else if( !strcmp( name, "bind" ) || !strcmp( name, "unbind" ) )
+	{
+		key_input_t k = { 0 };
+		char *part, *key_save, *next = strtok_r( value, "+", &key_save );
+
+		while( ( part = next ) )
+		{
+			// The last part is the key, the rest are modifiers
+			if( !( next = strtok_r( NULL, "+", &key_save ) ) )
+				k.key = XStringToKeysym( part );
+			else
+			{
+				uint32_t mask = config_modifier( part );
+
+				if( !mask )
+					return "bad modifier";
+
+				k.mod |= mask;
+			}
+		}
+
+		if( k.key == NoSymbol )
+			return "bad key";
+
+		if( name[0] == 'b' )
+		{
+			char *action = strtok_r( NULL, " \t\n", &save );
+			int i;
+
+			for( i = 0; action && i < LENGTH( ACTIONS ); i++ )
+				if( !strcmp( action, ACTIONS[i].name ) )
+					break;
+
+			if( !action || i == LENGTH( ACTIONS ) )
+				return "bad action";
+
+			k.f = ACTIONS[i].f;
+
+			if( k.f == run )
+			{
+				if( !( k.a.p = config_command( c, strtok_r( NULL, " \t\n", &save ), &save ) ) )
+					return "bad command";
+			}
+			else if( ( value = strtok_r( NULL, " \t\n", &save ) ) )
+			{
+				k.a.x = strtoull( value, &end, 0 );
+
+				if( *end )
+					return "bad argument";
+			}
+
+			if( ( ( k.f == to_workspace || k.f == window_to_workspace ) && k.a.x >= LENGTH( workspaces ) ) ||
+			    ( k.f == window_push && k.a.x > 3 ) ||
+			    ( k.f == workspace_layout && k.a.x >= LAYOUT_COUNT ) )
+				return "bad argument";
+		}
+
+		if( c->key_count == MAX_KEYS )
+			return "too many bindings";
+
+		c->keys[c->key_count++] = k;
+	}
+	else if( !strcmp( name, "rule" ) )
+	{
+		static char const *fields[] = {
+			[RULE_TITLE]    = "title",
+			[RULE_INSTANCE] = "instance",
+			[RULE_CLASS]    = "class",
+		};
+		char *match = strtok_r( NULL, " \t\n", &save ), *word;
+		rule_t *r = config_alloc( c, sizeof( rule_t ) );
+		uint8_t f;
+
+		for( f = 0; f < RULE_COUNT && strcmp( value, fields[f] ); f++ );
+
+		if( f == RULE_COUNT )
+			return "bad field";
+
+		if( !match || !r || !( r->value = config_alloc( c, strlen( match ) + 1 ) ) )
+			return "bad rule";
+
+		strcpy( ( char * ) r->value, match );
+		r->field     = f;
+		r->hash      = rule_hash( f, match );
+		r->workspace = -1;
+		r->floating  = -1;
+		r->focus     = 1;
+		r->geometry  = ( rect_t ) { 0 };
+
+		while( ( word = strtok_r( NULL, " \t\n", &save ) ) )
+		{
+			if( !strcmp( word, "workspace" ) )
+			{
+				char *n = strtok_r( NULL, " \t\n", &save );
+				unsigned long workspace = n ? strtoul( n, &end, 0 ) : 0;
+
+				if( !n || *end || workspace >= LENGTH( workspaces ) )
+					return "bad workspace";
+
+				r->workspace = workspace;
+			}
+			else if( !strcmp( word, "floating" ) || !strcmp( word, "tiled" ) )
+				r->floating = word[0] == 'f';
+			else if( !strcmp( word, "nofocus" ) )
+				r->focus = 0;
+			else if( !strcmp( word, "geometry" ) )
+			{
+				int32_t g[4];
+
+				for( int j = 0; j < 4; j++ )
+				{
+					char *n = strtok_r( NULL, " \t\n", &save );
+
+					if( !n || ( g[j] = strtol( n, &end, 0 ), *end ) || ( j >= 2 && g[j] <= 0 ) )
+						return "bad geometry";
+				}
+
+				r->geometry = ( rect_t ) { g[0], g[1], g[2], g[3] };
+				r->floating = 1;
+			}
+			else
+				return "bad rule";
+		}
+
+		r->next = c->rules[r->hash & ( RULE_BUCKETS - 1 )];
+		c->rules[r->hash & ( RULE_BUCKETS - 1 )] = r;
+		c->rule_fields |= 1 << f;
+	}
+	else
+		return "unknown setting";
+
+	return NULL;
+}
+
+
+// config_apply()
+//
+// Switch to a new configuration at once. Keys are only regrabbed when a
+// binding's key or modifiers changed, or it gained or lost its action, and
+// then grab_input() only touches the grabs that differ. A gap change lays out
+// the tiled workspaces again, moving only the windows whose tile changed, and
+// snaps again the floating and fullscreen windows that sat on a tile of the
+// old gap. A border change reaches every window, and the tiled windows are
+// sized again to fit their borders
+//
+// c - The configuration, owned from here on
+
+void config_apply( config_t *c )
+{
+	#ifdef DEBUG
+		uint64_t t = monotonic();
+	#endif
+
+	config_t *last = config;
+	uint8_t keys   = c->key_count != last->key_count || c->mod != last->mod;
+	uint8_t gap    = c->gap != last->gap;
+	uint8_t border = c->border != last->border;
+
+	for( uint32_t i = 0; i < c->key_count && !keys; i++ )
+		keys = c->keys[i].key != last->keys[i].key || c->keys[i].mod != last->keys[i].mod || 
+		       !c->keys[i].f != !last->keys[i].f;
+
+	config = c;
+
+	if( keys )
+		grab_input();
+
+	for( int i = 0; i < LENGTH( workspaces ) && ( gap || border ); i++ )
+	{
+		client_t *w = workspaces[i];
+
+		if( border && w )
+			do
+			{
+				w->border = c->border;
+				XSetWindowBorderWidth( display, w->window, c->border );
+			}
+			while( ( w = w->next ) != workspaces[i] );
+
+		workspace_tile( i );
+
+		// The tile stays the same, only its rectangle moves with the gap
+		if( gap && w )
+			do
+			{
+				if( layouts[i] && !w->floating )
+					continue;
+
+				rect_t s = AREA( i );
+				rect_t o = layout_snap( s, last->gap, w->tile );
+				rect_t n = layout_snap( s, c->gap, w->tile );
+
+				if( w->x != o.x || w->y != o.y || w->w != o.w || w->h != o.h )
+					continue;
+
+				w->x = n.x;
+				w->y = n.y;
+				w->w = n.w;
+				w->h = n.h;
+				batch_configure( w );
+			}
+			while( ( w = w->next ) != workspaces[i] );
+	}
+
+	if( last != &defaults )
+		free( last );
+
+	#ifdef DEBUG
+		fprintf( stderr, "CONFIG keys %d gap %d border %d %.3f ms\n", keys, gap, border, 
+		         ( monotonic() - t ) / 1e6 );
+	#endif
+}
+
+
+// config_open()
+//
+// Watch the directory of the configuration file, as editors often replace a
+// file by renaming a new one over it
+
+void config_open()
+{
+	char directory[PATH_MAX];
+	char *slash = strrchr( config_path, '/' );
+
+	snprintf( directory, sizeof( directory ), "%.*s", ( int ) ( slash - config_path ), config_path );
+
+	config_fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+	if( config_fd < 0 || inotify_add_watch( config_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO ) < 0 )
+	{
+		if( errno != ENOENT )
+			perror( directory );
+
+		if( config_fd >= 0 )
+			close( config_fd );
+
+		config_fd = -1;
+		return;
+	}
+
+	watch_add( config_fd, config_event );
+}
+
+
+// config_event()
+//
+// Reload the configuration CONFIG_DELAY milliseconds after the last change
+// to the file, so that an editor saving in several steps, or a burst of
+// saves, costs a single reload of the finished file
+//
+// fd - The inotify descriptor
+
+void config_event( int fd )
+{
+	char buffer[4096] __attribute__(( aligned( __alignof__( struct inotify_event ) ) ));
+	char const *name = strrchr( config_path, '/' ) + 1;
+	uint8_t changed = 0;
+	ssize_t n;
+
+	while( ( n = read( fd, buffer, sizeof( buffer ) ) ) > 0 )
+		for( char *p = buffer; p < buffer + n; )
+		{
+			struct inotify_event *e = ( struct inotify_event * ) p;
+
+			if( e->len && !strcmp( e->name, name ) )
+				changed = 1;
+
+			p += sizeof( *e ) + e->len;
+		}
+
+	if( changed )
+		timeout_add( &config_timeout, CONFIG_DELAY );
+}
+
+
+// config_reload()
+//
+// Read the configuration file again and apply it, keeping the configuration
+// in use when the file has an error
+//
+// a - Unused parameter
+
+void config_reload( argument_t const a )
+{
+	config_t *c = config_read();
+
+	if( c )
+		config_apply( c );
+}
+
+#endif // CONFIG
+////////////////////////////////////////////////////////////////////////////////
+
+
+// ewmh_setup()
+//
+// Intern every atom in a single round trip, then announce the window manager
+// through a check window and the hints it supports on the root
+
+void ewmh_setup()
+{
+	long desktops = LENGTH( workspaces );
+
+	XInternAtoms( display, ATOMS, ATOM_COUNT, False, atoms );
+
+	check = XCreateSimpleWindow( display, root, -1, -1, 1, 1, 0, 0, 0 );
+
+	XChangeProperty( display, check, atoms[NET_SUPPORTING_WM_CHECK], XA_WINDOW, 32, 
+	                 PropModeReplace, ( unsigned char * ) &check, 1 );
+	XChangeProperty( display, check, atoms[NET_WM_NAME], atoms[UTF8_STRING], 8, 
+	                 PropModeReplace, ( unsigned char * ) "wm", 2 );
+	XChangeProperty( display, root, atoms[NET_SUPPORTING_WM_CHECK], XA_WINDOW, 32, 
+	                 PropModeReplace, ( unsigned char * ) &check, 1 );
+	XChangeProperty( display, root, atoms[NET_SUPPORTED], XA_ATOM, 32, PropModeReplace, 
+	                 ( unsigned char * ) &atoms[NET_SUPPORTED], 
+	                 NET_WM_STATE_FULLSCREEN - NET_SUPPORTED + 1 );
+	XChangeProperty( display, root, atoms[NET_NUMBER_OF_DESKTOPS], XA_CARDINAL, 32, 
+	                 PropModeReplace, ( unsigned char * ) &desktops, 1 );
+
+	// Whatever the root holds is written over by the first flush
+	client_list_stale = 1;
+	active_written    = ~0UL;
+	desktop_written   = ~0;
+}
+
+
+// ewmh_flush()
+//
+// Write the client and root properties that changed during the batch, at
+// most one write each. Windows mapped since the last flush are appended to
+// _NET_CLIENT_LIST, it is only rewritten whole after a window left it
+
+void ewmh_flush()
+{
+	for( uint32_t i = 0; i < ewmh_count; i++ )
+	{
+		client_t *c = window_find( ewmh_queue[i] );
+
+		if( c )
+			ewmh_client_write( c );
+	}
+
+	ewmh_count = 0;
+
+	if( desktop_written != workspace )
+	{
+		long desktop = workspace;
+
+		XChangeProperty( display, root, atoms[NET_CURRENT_DESKTOP], XA_CARDINAL, 32, 
+		                 PropModeReplace, ( unsigned char * ) &desktop, 1 );
+		desktop_written = workspace;
+		property_writes++;
+	}
+
+	if( active_written != active_window )
+	{
+		XChangeProperty( display, root, atoms[NET_ACTIVE_WINDOW], XA_WINDOW, 32, 
+		                 PropModeReplace, ( unsigned char * ) &active_window, 1 );
+		active_written = active_window;
+		property_writes++;
+	}
+
+	if( client_list_stale || client_list_written < client_list_length )
+	{
+		uint32_t from = client_list_stale ? 0 : client_list_written;
+
+		XChangeProperty( display, root, atoms[NET_CLIENT_LIST], XA_WINDOW, 32, 
+		                 client_list_stale ? PropModeReplace : PropModeAppend, 
+		                 ( unsigned char * ) ( client_list + from ), 
+		                 client_list_length - from );
+		client_list_written = client_list_length;
+		client_list_stale   = 0;
+		property_writes++;
+	}
+}
+
+
+// ewmh_client_add()
+//
+// Add a window to the end of _NET_CLIENT_LIST, written at the next flush
+//
+// window - The Window
+
+void ewmh_client_add( Window window )
+{
+	if( client_list_length == client_list_size )
+	{
+		uint32_t size = client_list_size ? client_list_size * 2 : 64;
+		Window *list  = realloc( client_list, size * sizeof( Window ) );
+
+		if( !list )
+			return;
+
+		client_list      = list;
+		client_list_size = size;
+	}
+
+	client_list[client_list_length++] = window;
+}
+
+
+// ewmh_client_remove()
+//
+// Remove a window from _NET_CLIENT_LIST, which is rewritten at the next flush
+//
+// window - The Window
+
+void ewmh_client_remove( Window window )
+{
+	for( uint32_t i = 0; i < client_list_length; i++ )
+		if( client_list[i] == window )
+		{
+			memmove( &client_list[i], &client_list[i + 1], 
+			         ( --client_list_length - i ) * sizeof( Window ) );
+			client_list_stale = 1;
+			return;
+		}
+}
+
+
+// ewmh_desktop()
+//
+// Have the workspace of a client written to its _NET_WM_DESKTOP at the next
+// flush
+//
+// c - The client
+
+void ewmh_desktop( client_t *c )
+{
+	ewmh_mark( c, EWMH_DESKTOP );
+}
+
+
+// ewmh_state()
+//
+// Have whether a client is fullscreen written to its _NET_WM_STATE at the
+// next flush
+//
+// c - The client
+
+void ewmh_state( client_t *c )
+{
+	ewmh_mark( c, EWMH_STATE );
+}
+
+
+// ewmh_mark()
+//
+// Queue a client for ewmh_client_write() at the next flush, once however
+// many of its properties change. Should the queue fill, it is written at once
+//
+// c    - The client
+// what - The EWMH_ flags of the properties that changed
+
+void ewmh_mark( client_t *c, uint8_t what )
+{
+	uint8_t queued = c->ewmh & ( EWMH_DESKTOP | EWMH_STATE );
+
+	c->ewmh |= what;
+
+	if( queued )
+		return;
+
+	if( ewmh_count < MAX_BATCH )
+		ewmh_queue[ewmh_count++] = c->window;
+	else
+		ewmh_client_write( c );
+}
+
+
+// ewmh_client_write()
+//
+// Write the queued properties of a client. _NET_WM_STATE keeps the atoms the
+// client set before it was managed, read the first time the state is written
+// as that costs a round trip
+//
+// c - The client
+
+void ewmh_client_write( client_t *c )
+{
+	if( c->ewmh & EWMH_DESKTOP )
+	{
+		long desktop = c->workspace;
+
+		XChangeProperty( display, c->window, atoms[NET_WM_DESKTOP], XA_CARDINAL, 32, 
+		                 PropModeReplace, ( unsigned char * ) &desktop, 1 );
+		property_writes++;
+	}
+
+	if( c->ewmh & EWMH_STATE )
+	{
+		Atom states[MAX_STATES + 1];
+		unsigned long n = 0;
+
+		if( !( c->ewmh & EWMH_READ ) )
+		{
+			Atom *list = NULL;
+
+			if( XGetWindowProperty( display, c->window, atoms[NET_WM_STATE], 0, MAX_STATES + 1, 
+			                        False, XA_ATOM, &(Atom){0}, &(int){0}, &n, &(unsigned long){0}, 
+			                        ( unsigned char ** ) &list ) == Success && list )
+			{
+				for( unsigned long i = 0; i < n && c->state_count < MAX_STATES; i++ )
+					if( list[i] != atoms[NET_WM_STATE_FULLSCREEN] )
+						c->states[c->state_count++] = list[i];
+
+				XFree( list );
+			}
+
+			c->ewmh |= EWMH_READ;
+		}
+
+		memcpy( states, c->states, c->state_count * sizeof( Atom ) );
+		n = c->state_count;
+
+		if( c->fullscreen )
+			states[n++] = atoms[NET_WM_STATE_FULLSCREEN];
+
+		XChangeProperty( display, c->window, atoms[NET_WM_STATE], XA_ATOM, 32, 
+		                 PropModeReplace, ( unsigned char * ) states, n );
+		property_writes++;
+	}
+
+	c->ewmh &= EWMH_READ;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// LAYOUT
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Pure geometry in integer arithmetic, free of X calls and global state.
+// Halves split the space left after three gaps so that both halves and the
+// gap between them always add up to the screen exactly. Gaps are dropped on
+// a screen too small to hold them
+
+
+// layout_span()
+//
+// Place a tile along one axis
+//
+// origin, length - The screen along the axis
+// gap            - The gap in pixels
+// half           - The tile along the axis
+// start, size    - Set to the placement
+
+static void layout_span( int32_t origin, uint32_t length, uint32_t gap, int8_t half, 
+                         int32_t *start, uint32_t *size )
+{
+	if( gap * 4 >= length )
+		gap = 0;
+
+	uint32_t inner = length - gap * 3;
+	uint32_t first = inner / 2;
+
+	if( !half )
+	{
+		*start = origin + gap;
+		*size  = MAX( length - gap * 2, 1 );
+	}
+	else if( half < 0 )
+	{
+		*start = origin + gap;
+		*size  = MAX( first, 1 );
+	}
+	else
+	{
+		*start = origin + gap * 2 + first;
+		*size  = MAX( inner - first, 1 );
+	}
+}
+
+
+// layout_snap()
+//
+// The rectangle of a tile
+//
+// s   - The screen
+// gap - The gap in pixels
+// t   - The tile
+
+rect_t layout_snap( rect_t s, uint32_t gap, tile_t t )
+{
+	rect_t r;
+
+	layout_span( s.x, s.w, gap, t.x, &r.x, &r.w );
+	layout_span( s.y, s.h, gap, t.y, &r.y, &r.h );
+
+	return r;
+}
+
+
+// layout_tile()
+//
+// The tile of a rectangle. An axis is halved when the rectangle spans at most
+// half of it, toward the side holding its origin
+//
+// s - The screen
+// r - The rectangle
+
+tile_t layout_tile( rect_t s, rect_t r )
+{
+	tile_t t = { 0, 0 };
+
+	if( r.w <= s.w - s.w / 2 )
+		t.x = r.x < s.x + ( int32_t ) ( s.w / 2 ) ? -1 : 1;
+
+	if( r.h <= s.h - s.h / 2 )
+		t.y = r.y < s.y + ( int32_t ) ( s.h / 2 ) ? -1 : 1;
+
+	return t;
+}
+
+
+// layout_push()
+//
+// The tile reached by pushing toward a direction, a half moves to the full
+// length and the full length to the half on that side. A tile already at
+// that edge is returned unchanged
+//
+// t         - The tile
+// direction - 0 right, 1 up, 2 left, 3 down
+
+tile_t layout_push( tile_t t, uint8_t direction )
+{
+	switch( direction )
+	{
+		case 0: t.x = MIN( t.x + 1, 1 );  break;
+		case 1: t.y = MAX( t.y - 1, -1 ); break;
+		case 2: t.x = MAX( t.x - 1, -1 ); break;
+		case 3: t.y = MIN( t.y + 1, 1 );  break;
+	}
+
+	return t;
+}
+
+
+// layout_edge()
+//
+// Find whether a point lies within snap pixels of a screen edge, and which
+// tile that edge snaps to
+//
+// s      - The screen
+// px, py - The point
+// snap   - The width of the edge in pixels
+// t      - Set to the tile when the point is at an edge
+
+int layout_edge( rect_t s, int32_t px, int32_t py, uint32_t snap, tile_t *t )
+{
+	int32_t x = px - s.x;
+	int32_t y = py - s.y;
+
+	*t = ( tile_t ) { 
+		x <= ( int32_t ) snap ? -1 : x >= ( int32_t ) ( s.w - snap ) ? 1 : 0,
+		y <= ( int32_t ) snap ? -1 : y >= ( int32_t ) ( s.h - snap ) ? 1 : 0
+	};
+
+	return t->x || t->y;
+}
+
+
+// layout_move()
+//
+// Offset a rectangle, keeping it on the screen
+//
+// s      - The screen
+// r      - The rectangle
+// dx, dy - The offset
+
+rect_t layout_move( rect_t s, rect_t r, int32_t dx, int32_t dy )
+{
+	r.x = BETWEEN( r.x + dx, s.x, s.x + ( int32_t ) s.w - ( int32_t ) r.w );
+	r.y = BETWEEN( r.y + dy, s.y, s.y + ( int32_t ) s.h - ( int32_t ) r.h );
+
+	return r;
+}
+
+
+// layout_resize()
+//
+// Grow a rectangle from its bottom right corner, keeping it on the screen.
+// The minimum wins over the screen for a rectangle near its far edge
+//
+// s       - The screen
+// r       - The rectangle
+// dw, dh  - The growth
+// minimum - The minimum width and height
+
+rect_t layout_resize( rect_t s, rect_t r, int32_t dw, int32_t dh, uint32_t minimum )
+{
+	int32_t w = MIN( ( int32_t ) r.w + dw, s.x + ( int32_t ) s.w - r.x );
+	int32_t h = MIN( ( int32_t ) r.h + dh, s.y + ( int32_t ) s.h - r.y );
+
+	r.w = MAX( w, ( int32_t ) minimum );
+	r.h = MAX( h, ( int32_t ) minimum );
+
+	return r;
+}
+
+
+// layout_center()
+//
+// Center a rectangle of the given size on the screen
+//
+// s    - The screen
+// w, h - The size
+
+rect_t layout_center( rect_t s, uint32_t w, uint32_t h )
+{
+	return ( rect_t ) { 
+		s.x + ( ( int32_t ) s.w - ( int32_t ) w ) / 2, 
+		s.y + ( ( int32_t ) s.h - ( int32_t ) h ) / 2, 
+		w, 
+		h 
+	};
+}
+
+
+// layout_step()
+//
+// Constrain one length to its hints, below the maximum and a whole number of
+// increments above the base. The minimum wins over the maximum and the
+// increments, rounding up to the next increment that reaches it
+//
+// v    - The length
+// min  - The minimum length, 0 for none
+// max  - The maximum length, 0 for none
+// base - The length increments are counted from
+// inc  - The increment, 0 or 1 for any length
+
+static uint32_t layout_step( uint32_t v, uint32_t min, uint32_t max, uint32_t base, uint32_t inc )
+{
+	if( max && v > max )
+		v = max;
+
+	if( inc > 1 && v > base )
+		v -= ( v - base ) % inc;
+
+	if( v < min )
+		v = inc > 1 && min > base ? min + ( inc - ( min - base ) % inc ) % inc : min;
+
+	return v;
+}
+
+
+// layout_hints()
+//
+// Constrain the size of a rectangle to a window's size hints, keeping its
+// position
+//
+// r - The rectangle
+// h - The hints
+//
+// Returns the rectangle at the nearest size the window accepts
+
+rect_t layout_hints( rect_t r, hints_t const *h )
+{
+	r.w = layout_step( r.w, h->min_w, h->max_w, h->base_w, h->inc_w );
+	r.h = layout_step( r.h, h->min_h, h->max_h, h->base_h, h->inc_h );
+
+	return r;
+}
+
+
+// layout_halve()
+//
+// Split a rectangle in two along one axis with a gap between the halves
+//
+// r     - The rectangle, set to the first half
+// gap   - The gap in pixels
+// axis  - 0 to split the width, 1 the height
+//
+// Returns the second half
+
+static rect_t layout_halve( rect_t *r, uint32_t gap, uint8_t axis )
+{
+	rect_t second = *r;
+	uint32_t *length = axis ? &r->h : &r->w;
+
+	// Too small to split, both halves share the rectangle
+	if( *length < 2 )
+		return second;
+
+	if( gap * 2 >= *length )
+		gap = 0;
+
+	uint32_t first = MAX( ( *length - gap ) / 2, 1 );
+
+	if( axis )
+	{
+		second.y = r->y + first + gap;
+		second.h = MAX( r->h - first - gap, 1 );
+	}
+	else
+	{
+		second.x = r->x + first + gap;
+		second.w = MAX( r->w - first - gap, 1 );
+	}
+
+	*length = first;
+
+	return second;
+}
+
+
+// layout_tiles()
+//
+// The rectangles of n tiled windows in layout order. Windows of a master
+// stack share the height of the right half, windows of a bsp layout take
+// the first half of the space left, alternating between the axes, so adding
+// or removing the last window only moves its neighbour. Windows past the
+// point where a pixel can no longer be halved share the last rectangle
+//
+// layout - The layout
+// s      - The screen
+// gap    - The gap in pixels
+// n      - The number of windows
+// r      - Set to the n rectangles
+
+void layout_tiles( layout_t layout, rect_t s, uint32_t gap, uint32_t n, rect_t *r )
+{
+	if( !n )
+		return;
+
+	if( n == 1 || layout == LAYOUT_FLOATING )
+	{
+		for( uint32_t i = 0; i < n; i++ )
+			r[i] = layout_snap( s, gap, ( tile_t ) { 0, 0 } );
+
+		return;
+	}
+
+	if( layout == LAYOUT_MASTER )
+	{
+		rect_t stack = layout_snap( s, gap, ( tile_t ) { 1, 0 } );
+		uint32_t count = n - 1;
+		uint32_t g = gap * ( count - 1 ) < stack.h ? gap : 0;
+		uint32_t inner = stack.h - g * ( count - 1 );
+
+		r[0] = layout_snap( s, gap, ( tile_t ) { -1, 0 } );
+
+		// The first windows of the stack take the pixels left over
+		for( uint32_t i = 0; i < count; i++ )
+		{
+			uint32_t h = inner / count, extra = inner % count;
+
+			r[i + 1] = ( rect_t ) { 
+				stack.x, 
+				stack.y + i * ( h + g ) + MIN( i, extra ), 
+				stack.w, 
+				MAX( h + ( i < extra ), 1 ) 
+			};
+		}
+
+		return;
+	}
+
+	rect_t area = layout_snap( s, gap, ( tile_t ) { 0, 0 } );
+
+	for( uint32_t i = 0; i < n - 1; i++ )
+	{
+		r[i] = area;
+		area = layout_halve( &r[i], gap, i % 2 );
+	}
+
+	r[n - 1] = area;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// TRACE
+////////////////////////////////////////////////////////////////////////////////
+
+
+// trace()
+//
+// Record a handled event in the trace ring and its handler's histogram
+//
+// e       - The handled XEvent
+// handler - The handler it was given to
+// start   - The monotonic time the handler started
+
+void trace( XEvent *e, handler_t handler, uint64_t start )
+{
+	uint64_t duration = monotonic() - start;
+	trace_t *t = &traces[trace_head++ & ( TRACE_SIZE - 1 )];
+
+	t->time     = start;
+	t->duration = MIN( duration, UINT32_MAX );
+	t->type     = e->type;
+	t->handler  = handler;
+	t->window   = e->xany.window;
+
+	histogram_add( &histograms[handler], duration );
+}
+
+
+// trace_dump()
+//
+// Write the trace ring, oldest first, followed by a percentile summary of
+// every handler's histogram. Times are in nanoseconds
+//
+// f - The stream to be written to
+
+void trace_dump( FILE *f )
+{
+	uint32_t n = MIN( trace_head, TRACE_SIZE );
+
+	fputs( "# time duration type window handler\n", f );
+
+	for( uint32_t i = trace_head - n; i != trace_head; i++ )
+	{
+		trace_t *t = &traces[i & ( TRACE_SIZE - 1 )];
+
+		fprintf( 
+			f, 
+			"%llu %u %u 0x%lx %s\n", 
+			( unsigned long long ) t->time, t->duration, t->type, t->window, HANDLERS[t->handler] 
+		);
+	}
+
+	fputs( "# handler count p50 p90 p99 p999 max\n", f );
+
+	for( int i = 0; i < HANDLER_COUNT; i++ )
+		fprintf( 
+			f, 
+			"%s %llu %llu %llu %llu %llu %llu\n", 
+			HANDLERS[i],
+			( unsigned long long ) histograms[i].count,
+			( unsigned long long ) histogram_percentile( &histograms[i], 0.5 ),
+			( unsigned long long ) histogram_percentile( &histograms[i], 0.9 ),
+			( unsigned long long ) histogram_percentile( &histograms[i], 0.99 ),
+			( unsigned long long ) histogram_percentile( &histograms[i], 0.999 ),
+			( unsigned long long ) histograms[i].max
+		);
+
+	fprintf( 
+		f, 
+		"spawn %llu %llu %llu %llu %llu %llu\n", 
+		( unsigned long long ) spawns.count,
+		( unsigned long long ) histogram_percentile( &spawns, 0.5 ),
+		( unsigned long long ) histogram_percentile( &spawns, 0.9 ),
+		( unsigned long long ) histogram_percentile( &spawns, 0.99 ),
+		( unsigned long long ) histogram_percentile( &spawns, 0.999 ),
+		( unsigned long long ) spawns.max
+	);
+
+	fflush( f );
+}
+
+
+// histogram_add()
+//
+// Count a value in the given histogram
+//
+// h - The histogram
+// v - The value
+
+void histogram_add( histogram_t *h, uint64_t v )
+{
+	if( v < 16 )
+		h->buckets[0][v]++;
+	else
+	{
+		int m = 63 - __builtin_clzll( v );
+		h->buckets[m - 3][( v >> ( m - 4 ) ) & 15]++;
+	}
+
+	h->count++;
+	h->max = MAX( h->max, v );
+}
+
+
+// histogram_percentile()
+//
+// The lower bound of the sub-bucket holding the given percentile
+//
+// h - The histogram
+// p - The percentile, between 0 and 1
+
+uint64_t histogram_percentile( histogram_t const *h, double p )
+{
+	uint64_t target = p * h->count, seen = 0;
+
+	for( int b = 0; b < LENGTH( h->buckets ); b++ )
+		for( int s = 0; s < 16; s++ )
+			if( ( seen += h->buckets[b][s] ) > target )
+				return b ? ( uint64_t ) ( 16 + s ) << ( b - 1 ) : s;
+
+	return h->max;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// LOOP
+////////////////////////////////////////////////////////////////////////////////
+
+
+#define TICK( t ) ( ( t ) / ( TIMER_TICK * 1000000ULL ) )
+
+
+// watch_add()
+//
+// Wait on the given file descriptor in the main loop
+//
+// fd - The file descriptor to be watched
+// f  - The function called with fd once it is readable
+
+void watch_add( int fd, void ( *f )( int ) )
+{
+	for( int i = 0; i < MAX_WATCHES; i++ )
+		if( !watches[i].f )
+		{
+			watches[i] = ( watch_t ) { fd, f };
+
+			epoll_ctl( 
+				epoll_fd, 
+				EPOLL_CTL_ADD, 
+				fd, 
+				&( struct epoll_event ) { .events = EPOLLIN, .data.ptr = &watches[i] }
+			);
+			return;
+		}
+
+	fprintf( stderr, "MAX_WATCHES reached, fd %d not watched\n", fd );
+}
+
+
+// watch_delete()
+//
+// Stop waiting on the given file descriptor
+//
+// fd - The file descriptor to be forgotten
+
+void watch_delete( int fd )
+{
+	for( int i = 0; i < MAX_WATCHES; i++ )
+		if( watches[i].f && watches[i].fd == fd )
+		{
+			epoll_ctl( epoll_fd, EPOLL_CTL_DEL, fd, NULL );
+			watches[i] = ( watch_t ) { 0 };
+			return;
+		}
+}
+
+
+// timeout_add()
+//
+// Call t->f( t->a ) once the given delay has passed, rearming the timer if
+// it was already pending
+//
+// t     - The timer to be armed
+// delay - The delay in milliseconds
+
+void timeout_add( timeout_t *t, uint32_t delay )
+{
+	timeout_cancel( t );
+
+	t->deadline = monotonic() + delay * 1000000ULL;
+	t->pending  = 1;
+
+	timeout_t **slot = &wheel[TICK( t->deadline ) % TIMER_SLOTS];
+	t->prev = NULL;
+	t->next = *slot;
+
+	if( *slot )
+		( *slot )->prev = t;
+
+	*slot = t;
+	timeout_arm();
+}
+
+
+// timeout_cancel()
+//
+// Disarm the given timer if it is pending
+//
+// t - The timer to be disarmed
+
+void timeout_cancel( timeout_t *t )
+{
+	if( !t->pending )
+		return;
+
+	if( t->prev )
+		t->prev->next = t->next;
+	else
+		wheel[TICK( t->deadline ) % TIMER_SLOTS] = t->next;
+
+	if( t->next )
+		t->next->prev = t->prev;
+
+	t->pending = 0;
+}
+
+
+// timeout_arm()
+//
+// Arm the timerfd for the earliest pending timer, or disarm it when no timer
+// is pending so that an idle window manager never wakes up
+
+void timeout_arm()
+{
+	uint64_t next = 0;
+	uint8_t  due = 0;
+
+	// Walk one revolution of the wheel from the current tick, the first
+	// slot holding a timer due within this revolution holds the earliest
+	for( uint64_t k = 0; k < TIMER_SLOTS && !due; k++ )
+		for( timeout_t *t = wheel[( wheel_tick + k ) % TIMER_SLOTS]; t; t = t->next )
+			if( TICK( t->deadline ) <= wheel_tick + k && ( !next || t->deadline < next ) )
+			{
+				next = t->deadline;
+				due  = 1;
+			}
+
+	// Otherwise every timer is further than a revolution away
+	for( uint64_t k = 0; k < TIMER_SLOTS && !due; k++ )
+		for( timeout_t *t = wheel[k]; t; t = t->next )
+			if( !next || t->deadline < next )
+				next = t->deadline;
+
+	timerfd_settime( 
+		timer_fd, 
+		TFD_TIMER_ABSTIME, 
+		&( struct itimerspec ) {
+			.it_value = {
+				.tv_sec  = next / 1000000000,
+				.tv_nsec = next % 1000000000
+			}
+		},
+		NULL
+	);
+}
+
+
+// timer_event()
+//
+// Run every timer whose deadline has passed, then rearm the timerfd
+//
+// fd - The timerfd
+
+void timer_event( int fd )
+{
+	uint64_t now = monotonic();
+	uint64_t expirations;
+
+	if( read( fd, &expirations, sizeof( expirations ) ) < 0 && errno != EAGAIN )
+		return;
+
+	// Visit each slot passed since the last run, at most one revolution
+	uint64_t last = MIN( TICK( now ), wheel_tick + TIMER_SLOTS - 1 );
+
+	for( ; wheel_tick <= last; wheel_tick++ )
+	{
+		timeout_t *t = wheel[wheel_tick % TIMER_SLOTS];
+
+		// A callback may arm or cancel other timers, so rescan the slot
+		// after every call
+		while( t )
+		{
+			if( t->deadline <= now )
+			{
+				timeout_cancel( t );
+				t->f( t->a );
+				t = wheel[wheel_tick % TIMER_SLOTS];
+			}
+			else
+				t = t->next;
+		}
+	}
+
+	wheel_tick = TICK( now );
+	timeout_arm();
+}
+
+
+// signal_event()
+//
+// Respond to the signals delivered through the signalfd
+//
+// fd - The signalfd
+
+void signal_event( int fd )
+{
+	struct signalfd_siginfo info;
+
+	while( read( fd, &info, sizeof( info ) ) == sizeof( info ) )
+		switch( info.ssi_signo )
+		{
+			case SIGCHLD:
+				process_reap();
+				break;
+
+			case SIGTERM:
+			case SIGINT:
+			case SIGHUP:
+				quit( ( argument_t ) { 0 } );
+				break;
+
+			case SIGUSR1:
+				trace_dump( stderr );
+				break;
+		}
+}
+
+
+// display_event()
+//
+// Handle every X event queued or waiting on the connection as one batch.
+// XEventsQueued() reads without flushing, so the requests of the batch are
+// held until batch_flush() sends their net result together
+//
+// fd - The X connection
+
+void display_event( int fd )
+{
+	XEvent ev;
+	uint32_t events = 0;
+
+	while( loop && XEventsQueued( display, QueuedAfterReading ) )
+	{
+		XNextEvent( display, &ev );
+		handle_event( &ev );
+		events++;
+	}
+
+	batch_flush( events );
+}
+
+
+// event_loop()
+//
+// Wait on the X connection, the timers, the signals and every watched file
+// descriptor. Queued X events are drained before every sleep, as Xlib may
+// have read them while waiting on a reply
+
+void event_loop()
+{
+	struct epoll_event events[MAX_WATCHES];
+	sigset_t mask;
+
+	sigemptyset( &mask );
+	sigaddset( &mask, SIGCHLD );
+	sigaddset( &mask, SIGTERM );
+	sigaddset( &mask, SIGINT );
+	sigaddset( &mask, SIGHUP );
+	sigaddset( &mask, SIGUSR1 );
+	sigprocmask( SIG_BLOCK, &mask, NULL );
+
+	epoll_fd  = epoll_create1( EPOLL_CLOEXEC );
+	signal_fd = signalfd( -1, &mask, SFD_NONBLOCK | SFD_CLOEXEC );
+	timer_fd  = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC );
+	wheel_tick = TICK( monotonic() );
+
+	watch_add( ConnectionNumber( display ), display_event );
+	watch_add( signal_fd, signal_event );
+	watch_add( timer_fd, timer_event );
+
+#ifdef CONTROL_SOCKET
+	control_open();
+#endif
+#ifdef CONFIG
+	config_open();
+#endif
+
+	loop = 1;
+	while( loop )
+	{
+		display_event( ConnectionNumber( display ) );
+
+		if( !loop )
+			break;
+
+		int n = epoll_wait( epoll_fd, events, LENGTH( events ), -1 );
+
+		for( int i = 0; i < n && loop; i++ )
+		{
+			watch_t *w = events[i].data.ptr;
+			w->f( w->fd );
+		}
+	}
+
+#ifdef CONTROL_SOCKET
+	control_close();
+#endif
+}
+
+
+#ifdef CONTROL_SOCKET
+
+////////////////////////////////////////////////////////////////////////////////
+// CONTROL
+////////////////////////////////////////////////////////////////////////////////
+
+
+// control_open()
+//
+// Listen on the control socket named after the display. The socket runs
+// programs, so it is only created in a $XDG_RUNTIME_DIR owned by the user
+// and closed to everyone else, where no other user can create it first,
+// and is itself only open to the user
+
+void control_open()
+{
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	char const *runtime = getenv( "XDG_RUNTIME_DIR" );
+	struct stat st;
+
+	if( !runtime || stat( runtime, &st ) || !S_ISDIR( st.st_mode ) || 
+	    st.st_uid != getuid() || ( st.st_mode & 077 ) )
+	{
+		fprintf( stderr, "CONTROL no private XDG_RUNTIME_DIR, control socket disabled\n" );
+		return;
+	}
+
+	if( snprintf( control_path, sizeof( control_path ), "%s/" CONTROL_SOCKET, 
+	              runtime, DisplayString( display ) ) >= sizeof( control_path ) )
+	{
+		fprintf( stderr, "CONTROL path too long, control socket disabled\n" );
+		control_path[0] = '\0';
+		return;
+	}
+
+	memcpy( address.sun_path, control_path, sizeof( address.sun_path ) - 1 );
+	unlink( control_path );
+
+	control_fd = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+
+	mode_t mask = umask( 077 );
+	int bound = control_fd >= 0 && !bind( control_fd, ( struct sockaddr * ) &address, sizeof( address ) );
+	umask( mask );
+
+	if( !bound || listen( control_fd, 8 ) )
+	{
+		perror( control_path );
+
+		if( control_fd >= 0 )
+			close( control_fd );
+
+		control_fd = -1;
+		return;
+	}
+
+	watch_add( control_fd, control_accept );
+}
+
+
+// control_close()
+//
+// Close the control socket and every connection to it
+
+void control_close()
+{
+	for( int i = 0; i < LENGTH( controls ); i++ )
+		if( controls[i].fd > 0 )
+			close( controls[i].fd );
+
+	if( control_fd >= 0 )
+	{
+		close( control_fd );
+		unlink( control_path );
+	}
+}
+
+
+// control_accept()
+//
+// Accept a connection to the control socket, from the user's own processes
+// only as told by the peer's credentials
+//
+// fd - The listening socket
+
+void control_accept( int fd )
+{
+	int c = accept4( fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC );
+	struct ucred peer;
+
+	if( c < 0 )
+		return;
+
+	if( getsockopt( c, SOL_SOCKET, SO_PEERCRED, &peer, &( socklen_t ) { sizeof( peer ) } ) || 
+	    peer.uid != getuid() )
+	{
+		close( c );
+		return;
+	}
+
+	for( int i = 0; i < LENGTH( controls ); i++ )
+		if( controls[i].fd <= 0 )
+		{
+			controls[i].fd = c;
+			controls[i].length = 0;
+			watch_add( c, control_read );
+			return;
+		}
+
+	close( c );
+}
+
+
+// control_read()
+//
+// Run every complete command received on the connection and answer the
+// whole batch with a single write, one reply line per command
+//
+// fd - The connection
+
+void control_read( int fd )
+{
+	control_t *c = NULL;
+	char reply[CONTROL_BUFFER * 4];
+	size_t length = 0;
+	ssize_t n;
+	unsigned long serial = NextRequest( display );
+
+	for( int i = 0; i < LENGTH( controls ); i++ )
+		if( controls[i].fd == fd )
+			c = &controls[i];
+
+	if( !c )
+		return;
+
+	while( ( n = read( fd, c->buffer + c->length, sizeof( c->buffer ) - c->length ) ) > 0 )
+	{
+		char *line = c->buffer, *end;
+		c->length += n;
+
+		while( ( end = memchr( line, '\n', c->buffer + c->length - line ) ) )
+		{
+			*end = '\0';
+
+			// Keep room for the longest reply
+			if( length > sizeof( reply ) - CONTROL_BUFFER )
+			{
+				send( fd, reply, length, MSG_NOSIGNAL );
+				length = 0;
+			}
+
+			length += control_command( line, reply + length, sizeof( reply ) - length );
+			line = end + 1;
+		}
+
+		c->length -= line - c->buffer;
+		memmove( c->buffer, line, c->length );
+
+		// A line longer than the buffer can never complete
+		if( c->length == sizeof( c->buffer ) )
+			c->length = 0;
+	}
+
+	// Commands are a batch of their own, as a batch of events is
+	crossing_ignore( serial );
+	batch_flush( 0 );
+
+	if( length )
+		send( fd, reply, length, MSG_NOSIGNAL );
+
+	if( n == 0 || ( n < 0 && errno != EAGAIN ) )
+	{
+		watch_delete( fd );
+		close( fd );
+		c->fd = 0;
+	}
+}
+
+
+// control_command()
+//
+// Run a single command line, writing its reply line
+//
+// line   - The command, without its newline
+// reply  - The reply buffer
+// length - The space left in the reply buffer
+
+int control_command( char *line, char *reply, size_t length )
+{
+	char *save, *name = strtok_r( line, " \t", &save );
+
+	if( !name )
+		return snprintf( reply, length, "error empty\n" );
+
+	for( int i = 0; i < LENGTH( COMMANDS ); i++ )
+	{
+		if( strcmp( name, COMMANDS[i].name ) )
+			continue;
+
+		char *argv[32] = { 0 };
+		int32_t geometry[4] = { 0 };
+		argument_t a = { 0 };
+
+		if( COMMANDS[i].f == run )
+		{
+			for( int j = 0; j < LENGTH( argv ) - 1; j++ )
+				if( !( argv[j] = strtok_r( NULL, " \t", &save ) ) )
+					break;
+
+			if( !argv[0] )
+				return snprintf( reply, length, "error usage\n" );
+
+			a.p = argv;
+		}
+		else if( COMMANDS[i].f == control_geometry )
+		{
+			for( int j = 0; j < LENGTH( geometry ); j++ )
+			{
+				char *t = strtok_r( NULL, " \t", &save );
+
+				if( !t )
+					return snprintf( reply, length, "error usage\n" );
+
+				geometry[j] = strtol( t, NULL, 0 );
+			}
+
+			a.p = geometry;
+		}
+		else
+		{
+			char *t = strtok_r( NULL, " \t", &save );
+
+			if( t )
+				a.x = strtoull( t, NULL, 0 );
+			else if( COMMANDS[i].f == to_workspace || COMMANDS[i].f == window_to_workspace )
+				return snprintf( reply, length, "error usage\n" );
+			else if( COMMANDS[i].reply == control_clients )
+				a.x = workspace;
+
+			if( ( COMMANDS[i].f == to_workspace || 
+			      COMMANDS[i].f == window_to_workspace ||
+			      COMMANDS[i].reply == control_clients ) && a.x >= LENGTH( workspaces ) )
+				return snprintf( reply, length, "error workspace\n" );
+
+			if( COMMANDS[i].f == window_push && a.x > 3 )
+				return snprintf( reply, length, "error direction\n" );
+
+			if( COMMANDS[i].f == workspace_layout && a.x >= LAYOUT_COUNT )
+				return snprintf( reply, length, "error layout\n" );
+		}
+
+		if( COMMANDS[i].f )
+			COMMANDS[i].f( a );
+
+		if( COMMANDS[i].reply )
+			return COMMANDS[i].reply( reply, length, a );
+
+		return snprintf( reply, length, "ok\n" );
+	}
+
+	return snprintf( reply, length, "error unknown %.32s\n", name );
+}
+
+
+// control_focus()
+//
+// Focus the given window, switching to its workspace first
+//
+// a.x - The Window to be focused
+
+void control_focus( argument_t const a )
+{
+	client_t *c = window_find( a.x );
+
+	if( !c )
+		return;
+
+	to_workspace( ( argument_t ) { .x = c->workspace } );
+	window_current( c->window );
+}
+
+
+// control_geometry()
+//
+// Move and resize the current window
+//
+// a.p - A pointer to the x, y, w and h to be applied
+
+void control_geometry( argument_t const a )
+{
+	int32_t const *g = a.p;
+
+	if( workspaces[workspace] && g[2] > 0 && g[3] > 0 )
+		window_move_resize( workspaces[workspace], ( rect_t ) { g[0], g[1], g[2], g[3] } );
+}
+
+
+// control_state()
+//
+// Reply with the current workspace followed by the client count of every
+// workspace
+//
+// reply  - The reply buffer
+// length - The space left in the reply buffer
+// a      - Unused parameter
+
+int control_state( char *reply, size_t length, argument_t const a )
+{
+	int n = snprintf( reply, length, "ok %u", workspace );
+
+	for( int i = 0; i < LENGTH( workspaces ); i++ )
+	{
+		uint32_t count = 0;
+		client_t *c = workspaces[i];
+
+		if( c )
+			do count++;
+			while( ( c = c->next ) != workspaces[i] );
+
+		n += snprintf( reply + n, length - n, " %u", count );
+	}
+
+	return n + snprintf( reply + n, length - n, "\n" );
+}
+
+
+// control_clients()
+//
+// Reply with the window and geometry of every client of a workspace, in
+// focus order
+//
+// reply  - The reply buffer
+// length - The space left in the reply buffer
+// a.x    - The workspace, the current one by default
+
+int control_clients( char *reply, size_t length, argument_t const a )
+{
+	int n = snprintf( reply, length, "ok" );
+	client_t *c = workspaces[a.x];
+
+	if( c )
+		do
+		{
+			if( length - n < 64 )
+				break;
+
+			n += snprintf( 
+				reply + n, 
+				length - n, 
+				" 0x%lx %d %d %u %u", 
+				c->window, c->x, c->y, c->w, c->h 
+			);
+		}
+		while( ( c = c->next ) != workspaces[a.x] );
+
+	return n + snprintf( reply + n, length - n, "\n" );
+}
+
+
+// control_outputs()
+//
+// Reply with the geometry and shown workspace of every output
+//
+// reply  - The reply buffer
+// length - The space left in the reply buffer
+// a      - Unused parameter
+
+int control_outputs( char *reply, size_t length, argument_t const a )
+{
+	int n = snprintf( reply, length, "ok" );
+
+	for( int i = 0; i < output_count; i++ )
+		n += snprintf( 
+			reply + n, 
+			length - n, 
+			" %d %d %u %u %u", 
+			outputs[i].r.x, outputs[i].r.y, outputs[i].r.w, outputs[i].r.h, outputs[i].workspace 
+		);
+
+	return n + snprintf( reply + n, length - n, "\n" );
+}
+
+
+// control_latency()
+//
+// Reply with the count, median, 99th percentile and maximum latency in
+// nanoseconds of every handler
+//
+// reply  - The reply buffer
+// length - The space left in the reply buffer
+// a      - Unused parameter
+
+int control_latency( char *reply, size_t length, argument_t const a )
+{
+	int n = snprintf( reply, length, "ok" );
+
+	for( int i = 0; i < HANDLER_COUNT; i++ )
+		n += snprintf( 
+			reply + n, 
+			length - n, 
+			" %s %llu %llu %llu %llu",
+			HANDLERS[i],
+			( unsigned long long ) histograms[i].count,
+			( unsigned long long ) histogram_percentile( &histograms[i], 0.5 ),
+			( unsigned long long ) histogram_percentile( &histograms[i], 0.99 ),
+			( unsigned long long ) histograms[i].max
+		);
+
+	n += snprintf( 
+		reply + n, 
+		length - n, 
+		" spawn %llu %llu %llu %llu",
+		( unsigned long long ) spawns.count,
+		( unsigned long long ) histogram_percentile( &spawns, 0.5 ),
+		( unsigned long long ) histogram_percentile( &spawns, 0.99 ),
+		( unsigned long long ) spawns.max
+	);
+
+	return n + snprintf( reply + n, length - n, "\n" );
+}
+
+
+// control_trace()
+//
+// Reply with the most recent trace entries, newest first, each as
+// time,duration,type,window,handler
+//
+// reply  - The reply buffer
+// length - The space left in the reply buffer
+// a.x    - The number of entries, 16 by default
+
+int control_trace( char *reply, size_t length, argument_t const a )
+{
+	uint32_t count = MIN( MIN( a.x ? a.x : 16, trace_head ), TRACE_SIZE );
+	int n = snprintf( reply, length, "ok" );
+
+	for( uint32_t i = 0; i < count && length - n > 80; i++ )
+	{
+		trace_t *t = &traces[( trace_head - 1 - i ) & ( TRACE_SIZE - 1 )];
+
+		n += snprintf( 
+			reply + n, 
+			length - n, 
+			" %llu,%u,%u,0x%lx,%s",
+			( unsigned long long ) t->time, t->duration, t->type, t->window, HANDLERS[t->handler] 
+		);
+	}
+
+	return n + snprintf( reply + n, length - n, "\n" );
+}
+
+
+// control_processes()
+//
+// Reply with the pid, milliseconds since spawn and command of every child
+// still running
+//
+// reply  - The reply buffer
+// length - The space left in the reply buffer
+// a      - Unused parameter
+
+int control_processes( char *reply, size_t length, argument_t const a )
+{
+	int n = snprintf( reply, length, "ok" );
+	uint64_t now = monotonic();
+
+	for( int i = 0; i < MAX_PROCESSES && length - n > 64; i++ )
+		if( processes[i].pid )
+			n += snprintf( 
+				reply + n, 
+				length - n, 
+				" %d %llu %s", 
+				processes[i].pid, 
+				( unsigned long long ) ( now - processes[i].start ) / 1000000,
+				processes[i].name 
+			);
+
+	return n + snprintf( reply + n, length - n, "\n" );
+}
+
+
+// control_memory()
+//
+// Reply with the live clients, the idle clients and slabs of the pool, the
+// bytes held by the pool and window index, and the lifetime counts of
+// clients managed and removed
+//
+// reply  - The reply buffer
+// length - The space left in the reply buffer
+// a      - Unused parameter
+
+int control_memory( char *reply, size_t length, argument_t const a )
+{
+	return snprintf( 
+		reply, 
+		length, 
+		"ok %u %u %u %zu %llu %llu\n", 
+		client_count, 
+		pool_idle, 
+		pool_slabs, 
+		pool_slabs * POOL_SLAB * sizeof( client_t ) + client_buckets * sizeof( client_t * ),
+		( unsigned long long ) created,
+		( unsigned long long ) removed
+	);
+}
+
+
+// control_counters()
+//
+// Reply with name and value pairs of the event counters
+//
+// reply  - The reply buffer
+// length - The space left in the reply buffer
+// a      - Unused parameter
+
+int control_counters( char *reply, size_t length, argument_t const a )
+{
+#ifdef OVERVIEW
+	int n = snprintf( 
+		reply, 
+		length, 
+		"ok damage_events %llu thumbnails_rendered %llu", 
+		( unsigned long long ) damages, 
+		( unsigned long long ) thumbnails_rendered
+	);
+#else
+	int n = snprintf( reply, length, "ok" );
+#endif
+
+	return n + snprintf( 
+		reply + n, 
+		length - n, 
+		" configure_forwarded %llu configure_refused %llu crossing_ignored %llu "
+		"focus_requested %llu focus_set %llu property_writes %llu rules_matched %llu "
+		"drags %llu drag_motions %llu drag_configures %llu\n", 
+		( unsigned long long ) configures_forwarded,
+		( unsigned long long ) configures_refused,
+		( unsigned long long ) crossings_ignored,
+		( unsigned long long ) focus_requests,
+		( unsigned long long ) focus_sets,
+		( unsigned long long ) property_writes,
+		( unsigned long long ) rules_matched,
+		( unsigned long long ) drags,
+		( unsigned long long ) drag_motions,
+		( unsigned long long ) drag_configures
+	);
+}
+
+
+// control_batches()
+//
+// Reply with the number of batches, the requests their handlers made and
+// those sent, then the count, p50, p99 and max of the events handled and the
+// requests coalesced away per batch
+//
+// reply  - The reply buffer
+// length - The space left in the reply buffer
+// a      - Unused parameter
+
+int control_batches( char *reply, size_t length, argument_t const a )
+{
+	return snprintf( 
+		reply, 
+		length, 
+		"ok batches %llu queued %llu sent %llu events %llu %llu %llu coalesced %llu %llu %llu\n",
+		( unsigned long long ) batches,
+		( unsigned long long ) requests_queued,
+		( unsigned long long ) requests_sent,
+		( unsigned long long ) histogram_percentile( &batch_events, 0.5 ),
+		( unsigned long long ) histogram_percentile( &batch_events, 0.99 ),
+		( unsigned long long ) batch_events.max,
+		( unsigned long long ) histogram_percentile( &batch_coalesced, 0.5 ),
+		( unsigned long long ) histogram_percentile( &batch_coalesced, 0.99 ),
+		( unsigned long long ) batch_coalesced.max
+	);
+}
+
+#endif // CONTROL_SOCKET
+
+
+static int xerror()
+{ 
+	return 0; 
+}
+
+
+// monotonic()
+//
+// The current monotonic time in nanoseconds
+
+uint64_t monotonic()
+{
+	struct timespec t;
+	clock_gettime( CLOCK_MONOTONIC, &t );
+	return ( uint64_t ) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+
+#ifdef BENCHMARK
+
+////////////////////////////////////////////////////////////////////////////////
+// BENCHMARK
+////////////////////////////////////////////////////////////////////////////////
+
+
+#define BENCHMARK_CLIENTS 10000
+#define BENCHMARK_WINDOWS 64   // Windows mapped by the end-to-end benchmarks
+#define BENCHMARK_MOTIONS 1000 // Motion events in each benchmarked drag
+#define BENCHMARK_REPEAT  32
+#define BENCHMARK_LAYOUTS 1000000 // Random cases checked by benchmark_layout()
+#define BENCHMARK_ADOPT   500  // Windows mapped before the window manager starts
+
+
+// Every result is printed as a single line of key=value pairs, times in
+// nanoseconds, so that runs of different versions can be diffed and parsed
+
+
+// benchmark()
+//
+// Run the client and layout microbenchmarks, then the end-to-end benchmarks
+// against a private Xvfb server when one can be started
+
+int benchmark()
+{
+	benchmark_clients();
+
+	if( workspaces[0] != NULL || client_count != 0 )
+		return 1;
+
+	if( benchmark_layout() )
+		return 1;
+
+	benchmark_spawn();
+
+	return benchmark_display();
+}
+
+
+// benchmark_clients()
+//
+// Time the client index and workspace ring operations over
+// BENCHMARK_CLIENTS clients
+
+void benchmark_clients()
+{
+	static client_t c[BENCHMARK_CLIENTS];
+	uint64_t t;
+	int i;
+
+	#define BENCHMARK_RUN( name, op )                                      \
+		t = monotonic();                                                   \
+		for( i = 0; i < BENCHMARK_CLIENTS; i++ ) { op; }                   \
+		printf( "name=%s count=%d mean=%.1f\n", name, BENCHMARK_CLIENTS,   \
+		        ( monotonic() - t ) / ( double ) BENCHMARK_CLIENTS )
+
+	for( i = 0; i < BENCHMARK_CLIENTS; i++ )
+		c[i].window = 0x400000 + i * 7;
+
+	BENCHMARK_RUN( "client_add", 
+		client_index( &c[i] ); client_link( &c[i], 0 ) );
+	BENCHMARK_RUN( "client_find", 
+		window_find( c[( i * 7919 ) % BENCHMARK_CLIENTS].window ) );
+	BENCHMARK_RUN( "client_front", 
+		client_t *r = &c[( i * 7919 ) % BENCHMARK_CLIENTS]; 
+		client_unlink( r ); client_link( r, 0 ) );
+	BENCHMARK_RUN( "client_next", 
+		workspaces[0] = workspaces[0]->next );
+	BENCHMARK_RUN( "client_previous", 
+		workspaces[0] = workspaces[0]->prev );
+	BENCHMARK_RUN( "client_delete", 
+		client_t *r = window_find( c[( i * 7919 ) % BENCHMARK_CLIENTS].window );
+		client_unlink( r ); client_unindex( r ) );
+
+	// The pool grows on the first pass, the second reuses it
+	static client_t *p[BENCHMARK_CLIENTS];
+
+	BENCHMARK_RUN( "client_alloc", p[i] = client_alloc() );
+	BENCHMARK_RUN( "client_free", client_free( p[i] ) );
+	BENCHMARK_RUN( "client_realloc", p[i] = client_alloc() );
+	BENCHMARK_RUN( "client_refree", client_free( p[i] ) );
+
+	#undef BENCHMARK_RUN
+}
+
+
+// xorshift()
+//
+// The next number of a 32 bit xorshift generator
+//
+// seed - The generator state
+
+static uint32_t xorshift( uint32_t *seed )
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+
+	return *seed;
+}
+
+
+// benchmark_layout()
+//
+// Check the layout functions against their invariants over BENCHMARK_LAYOUTS
+// random screens, gaps and rectangles, then time them. Returns nonzero and
+// prints the failing case when an invariant does not hold
+
+int benchmark_layout()
+{
+	static rect_t screens[BENCHMARK_CLIENTS];
+	uint32_t seed = 2463534242;
+	volatile int32_t sink = 0;
+	uint64_t t;
+	int i;
+
+	#define RANDOM( n ) ( ( int32_t ) ( xorshift( &seed ) % ( n ) ) )
+
+	#define CHECK( condition )                                                \
+		if( !( condition ) )                                                  \
+		{                                                                     \
+			printf( "name=layout_check failed=\"%s\" screen=%d,%d,%ux%u "   \
+			        "gap=%u tile=%d,%d\n", #condition, s.x, s.y, s.w, s.h,    \
+			        gap, tl.x, tl.y );                                        \
+			return 1;                                                         \
+		}
+
+	for( i = 0; i < BENCHMARK_LAYOUTS; i++ )
+	{
+		rect_t s = { 
+			RANDOM( 8192 ) - 4096, RANDOM( 8192 ) - 4096, 
+			RANDOM( 7680 ) + 1,    RANDOM( 4320 ) + 1
+		};
+		uint32_t gap = RANDOM( 64 );
+		tile_t tl = { RANDOM( 3 ) - 1, RANDOM( 3 ) - 1 };
+		rect_t r = layout_snap( s, gap, tl );
+		rect_t a = layout_snap( s, gap, ( tile_t ) { -1, -1 } );
+		rect_t b = layout_snap( s, gap, ( tile_t ) { 1, 1 } );
+
+		// Tiles stay on the screen, and two halves fill it with equal gaps
+		CHECK( r.w > 0 && r.h > 0 );
+		CHECK( r.x >= s.x && r.x + ( int64_t ) r.w <= s.x + ( int64_t ) s.w );
+		CHECK( r.y >= s.y && r.y + ( int64_t ) r.h <= s.y + ( int64_t ) s.h );
+		CHECK( s.w < 4 || b.x + b.w - a.x == s.w - ( a.x - s.x ) * 2 );
+		CHECK( s.h < 4 || b.y + b.h - a.y == s.h - ( a.y - s.y ) * 2 );
+		CHECK( s.w < 4 || b.x - a.x - ( int32_t ) a.w == a.x - s.x );
+		CHECK( s.h < 4 || b.y - a.y - ( int32_t ) a.h == a.y - s.y );
+
+		// A tile is recovered from its rectangle on screens wide enough to
+		// tell a half from the full length
+		tile_t u = layout_tile( s, r );
+		CHECK( s.w <= gap * 8 + 2 || u.x == tl.x );
+		CHECK( s.h <= gap * 8 + 2 || u.y == tl.y );
+
+		// Pushing twice toward an edge is the same as pushing once more
+		uint8_t d = RANDOM( 4 );
+		tile_t p = layout_push( layout_push( tl, d ), d );
+		tile_t q = layout_push( p, d );
+		CHECK( p.x == q.x && p.y == q.y );
+
+		// Moves and resizes of a rectangle that fits stay on the screen
+		rect_t m = { s.x, s.y, RANDOM( s.w ) + 1, RANDOM( s.h ) + 1 };
+		m = layout_move( s, m, RANDOM( 20000 ) - 10000, RANDOM( 20000 ) - 10000 );
+		CHECK( m.x >= s.x && m.x + ( int64_t ) m.w <= s.x + ( int64_t ) s.w );
+		CHECK( m.y >= s.y && m.y + ( int64_t ) m.h <= s.y + ( int64_t ) s.h );
+
+		if( s.w >= MINIMUM_SIZE * 2 && s.h >= MINIMUM_SIZE * 2 )
+		{
+			m = layout_resize( s, m, RANDOM( 20000 ) - 10000, RANDOM( 20000 ) - 10000, 
+			                   MINIMUM_SIZE );
+			CHECK( m.x + ( int64_t ) m.w <= s.x + ( int64_t ) s.w || m.w == MINIMUM_SIZE );
+			CHECK( m.y + ( int64_t ) m.h <= s.y + ( int64_t ) s.h || m.h == MINIMUM_SIZE );
+			CHECK( m.w >= MINIMUM_SIZE && m.h >= MINIMUM_SIZE );
+		}
+
+		// Hinted sizes reach the minimum, stay under a maximum the minimum
+		// allows, fall on an increment above the base and are settled
+		hints_t h = { 
+			RANDOM( 500 ), RANDOM( 500 ), 0, 0, 
+			RANDOM( 500 ), RANDOM( 500 ), RANDOM( 33 ), RANDOM( 33 )
+		};
+		h.max_w = RANDOM( 2 ) ? 0 : RANDOM( 2000 );
+		h.max_h = RANDOM( 2 ) ? 0 : RANDOM( 2000 );
+
+		rect_t n = layout_hints( m, &h );
+		rect_t o = layout_hints( n, &h );
+
+		CHECK( n.x == m.x && n.y == m.y );
+		CHECK( n.w >= h.min_w && n.h >= h.min_h );
+		CHECK( !h.max_w || n.w <= h.max_w || n.w < h.min_w + MAX( h.inc_w, 1 ) );
+		CHECK( !h.max_h || n.h <= h.max_h || n.h < h.min_h + MAX( h.inc_h, 1 ) );
+		CHECK( h.inc_w < 2 || n.w <= h.base_w || ( n.w - h.base_w ) % h.inc_w == 0 );
+		CHECK( h.inc_h < 2 || n.h <= h.base_h || ( n.h - h.base_h ) % h.inc_h == 0 );
+		CHECK( n.w <= MAX( m.w, h.min_w + MAX( h.inc_w, 1 ) - 1 ) );
+		CHECK( o.w == n.w && o.h == n.h );
+	}
+
+	printf( "name=layout_check count=%d failed=0\n", BENCHMARK_LAYOUTS );
+
+	// Random outputs that never overlap, against a scan of every output
+	for( i = 0; i < BENCHMARK_LAYOUTS / 1000; i++ )
+	{
+		rect_t s = { 0, 0, 0, 0 };
+		tile_t tl = { 0, 0 };
+		uint32_t gap = 0;
+
+		output_count = 0;
+
+		for( int j = 0; j < 64 && output_count < MAX_OUTPUTS; j++ )
+		{
+			rect_t r = { RANDOM( 4000 ), RANDOM( 4000 ), 1 + RANDOM( 2000 ), 1 + RANDOM( 2000 ) };
+			int k = 0;
+
+			for( ; k < output_count; k++ )
+			{
+				rect_t o = outputs[k].r;
+
+				if( r.x < o.x + ( int32_t ) o.w && o.x < r.x + ( int32_t ) r.w && 
+				    r.y < o.y + ( int32_t ) o.h && o.y < r.y + ( int32_t ) r.h )
+					break;
+			}
+
+			if( k == output_count )
+				outputs[output_count++].r = r;
+		}
+
+		output_index();
+
+		for( int j = 0; j < 100; j++ )
+		{
+			int32_t x = RANDOM( 6000 ), y = RANDOM( 6000 );
+			uint8_t found = 0;
+
+			for( int k = 0; k < output_count; k++ )
+			{
+				s = outputs[k].r;
+
+				if( x >= s.x && x < s.x + ( int32_t ) s.w && y >= s.y && y < s.y + ( int32_t ) s.h )
+					found = k;
+			}
+
+			CHECK( output_at( x, y ) == found );
+		}
+	}
 
-void window_kill( argument_t const a )
-{
-	#ifdef DEBUG
-		fputs( "WINDOW KILL\n", stderr );
-	#endif
+	// Four outputs, three side by side and one below the middle
+	output_count = 4;
+	outputs[0].r = ( rect_t ) { 0,    0,    1920, 1080 };
+	outputs[1].r = ( rect_t ) { 1920, 0,    2560, 1440 };
+	outputs[2].r = ( rect_t ) { 1920, 1440, 2560, 1440 };
+	outputs[3].r = ( rect_t ) { 4480, 0,    1080, 1920 };
+	output_index();
 
-    if( workspaces[workspace] ) 
+	for( i = 0; i < BENCHMARK_LAYOUTS / 100; i++ )
 	{
-		XKillClient( display, workspaces[workspace]->window );
+		int32_t x = RANDOM( 5560 ), y = RANDOM( 2880 );
+		rect_t s = outputs[output_at( x, y )].r;
+		tile_t tl = { 0, 0 };
+		uint32_t gap = 0;
 
-		client_t *head =  workspaces[workspace]->next;
-		free( workspaces[workspace] );
-		workspaces[workspace] = head;
-		
-		if( workspaces[workspace] )
-			window_current( workspaces[workspace]->window );
+		CHECK( ( x >= s.x && x < s.x + ( int32_t ) s.w && y >= s.y && y < s.y + ( int32_t ) s.h ) ||
+		       ( x < 1920 && y >= 1080 ) || ( x >= 4480 && y >= 1920 ) );
 	}
-}
 
+	t = monotonic();
 
-// window_current()
-//
-// Raise, focus and move the given window to front of the client list
-//
-// window - The Window to be raised and focused
+	for( i = 0; i < BENCHMARK_CLIENTS; i++ )
+		sink += output_at( i % 5560, i % 2880 );
 
-void window_current( Window window )
-{
-	#ifdef DEBUG
-		fputs( "WINDOW CURRENT\n", stderr );
-	#endif
+	printf( "name=output_at outputs=%u count=%d mean=%.1f\n", output_count, BENCHMARK_CLIENTS, 
+	        ( monotonic() - t ) / ( double ) BENCHMARK_CLIENTS );
 
-	if( !workspaces[workspace] )
-		return;
+	memset( outputs, 0, sizeof( outputs ) );
+	output_count = 0;
+	output_index();
 
-	// Only moves client if it is not at the front
-	if( workspaces[workspace]->window != window )
+	// Tiles of every layout stay on the screen and, up to sixteen windows,
+	// never overlap. Count the windows that move as a window is added
+	for( layout_t l = LAYOUT_MASTER; l < LAYOUT_COUNT; l++ )
 	{
-		window_delete( window );
-		window_add( window );	
-    }
+		static rect_t r[BENCHMARK_WINDOWS], q[BENCHMARK_WINDOWS];
+		rect_t s = { 0, 0, 1920, 1080 };
+		uint32_t moved = 0, gap = GAP;
+		tile_t tl = { 0, 0 };
 
-	XSetInputFocus(display, window, RevertToParent, CurrentTime);
-	XRaiseWindow( display, window );
-}
+		for( uint32_t n = 1; n <= BENCHMARK_WINDOWS; n++ )
+		{
+			layout_tiles( l, s, gap, n, r );
 
+			for( uint32_t j = 0; j < n; j++ )
+			{
+				CHECK( r[j].w > 0 && r[j].h > 0 );
+				CHECK( r[j].x >= s.x && r[j].x + r[j].w <= s.x + s.w );
+				CHECK( r[j].y >= s.y && r[j].y + r[j].h <= s.y + s.h );
 
-// window_center()
-//
-// Center the given window on the screen
-//
-// window - The Window to be centered
+				for( uint32_t k = 0; k < j && n <= 16; k++ )
+					CHECK( r[j].x >= r[k].x + ( int32_t ) r[k].w || r[k].x >= r[j].x + ( int32_t ) r[j].w ||
+					       r[j].y >= r[k].y + ( int32_t ) r[k].h || r[k].y >= r[j].y + ( int32_t ) r[j].h );
 
-void window_center( Window window )
-{
-	#ifdef DEBUG
-		fputs( "WINDOW CENTER\n", stderr );
-	#endif
+				if( j < n - 1 && memcmp( &r[j], &q[j], sizeof( rect_t ) ) )
+					moved++;
+			}
 
-	uint32_t w, h;
-	window_size( window, &(int){0}, &(int){0}, &w, &h );
-	XMoveWindow( display, window, (sw - w) / 2, (sh - h) / 2 );
+			memcpy( q, r, sizeof( r ) );
+		}
+
+		printf( 
+			"name=layout_tiles layout=%s windows=%d moved_per_add=%.2f\n", 
+			l == LAYOUT_MASTER ? "master" : "bsp", BENCHMARK_WINDOWS, 
+			moved / ( double ) BENCHMARK_WINDOWS 
+		);
+	}
+
+	for( i = 0; i < BENCHMARK_CLIENTS; i++ )
+		screens[i] = ( rect_t ) { 0, 0, RANDOM( 7680 ) + 1, RANDOM( 4320 ) + 1 };
+
+	#define BENCHMARK_RUN( name, op )                                      \
+		t = monotonic();                                                   \
+		for( i = 0; i < BENCHMARK_CLIENTS; i++ ) { op; }                   \
+		printf( "name=%s count=%d mean=%.1f\n", name, BENCHMARK_CLIENTS,   \
+		        ( monotonic() - t ) / ( double ) BENCHMARK_CLIENTS )
+
+	BENCHMARK_RUN( "layout_snap", 
+		sink += layout_snap( screens[i], GAP, ( tile_t ) { i % 3 - 1, i % 3 - 1 } ).w );
+	BENCHMARK_RUN( "layout_tile", 
+		sink += layout_tile( screens[i], screens[( i * 7919 ) % BENCHMARK_CLIENTS] ).x );
+	BENCHMARK_RUN( "layout_move", 
+		sink += layout_move( screens[i], screens[0], i, -i ).x );
+	BENCHMARK_RUN( "layout_hints", 
+		sink += layout_hints( screens[i], &( hints_t ) { 100, 50, 0, 0, 4, 2, 7, 13 } ).w );
+
+	#undef BENCHMARK_RUN
+	#undef CHECK
+	#undef RANDOM
+
+	return 0;
 }
 
 
-// window_fullscreen()
+// benchmark_spawn()
 //
-// Resize the window to take up the full screen
-//
-// window - The Window to be resized
+// Time run() from the call to the child being tracked, with the $PATH
+// lookup cached after the first spawn, and reap the children
 
-void window_fullscreen( argument_t const a )
+void benchmark_spawn()
 {
-	#ifdef DEBUG
-		fputs( "WINDOW FULLSCREEN\n", stderr );
-	#endif
-
-	XMoveResizeWindow( 
-		display, 
-		workspaces[workspace]->window,
-	#ifdef GAPS
-		GAP_PIXELS,
-		GAP_PIXELS,
-		sw - GAP_PIXELS * 2,
-		sh - GAP_PIXELS * 2
-	#else
-		0,
-		0,
-		sw,
-		sh
-	#endif	
-	);
-}
+	char const *argv[] = { "true", NULL };
+	uint64_t t = monotonic();
 
+	for( int i = 0; i < BENCHMARK_REPEAT; i++ )
+		run( ( argument_t ) { .p = argv } );
 
-void window_next( argument_t const a )
-{
-	if( !workspaces[workspace] || !workspaces[workspace]->next )
-		return;
+	t = monotonic() - t;
 
-	client_t *tail = workspaces[workspace];
-	workspaces[workspace] = tail->next;
-	tail->next = NULL;
+	while( waitpid( -1, NULL, 0 ) > 0 );
+	process_reap();
 
-	client_t *c = workspaces[workspace];
-	while( c->next )
-		c = c->next;
+	printf( "name=spawn count=%d mean=%.1f\n", BENCHMARK_REPEAT, t / ( double ) BENCHMARK_REPEAT );
 
-	c->next = tail;
-	window_current( workspaces[workspace]->window );
+	memset( processes, 0, sizeof( processes ) );
 }
 
 
-void window_previous( argument_t const a )
-{
-	if( !workspaces[workspace] || !workspaces[workspace]->next )
-		return;
+// benchmark_display()
+//
+// Manage windows of a synthetic client on a private Xvfb server, timing
+// MapRequest until the window is focused and fullscreen, workspace switches
+// with BENCHMARK_WINDOWS windows, drag throughput and key binding latency.
+// Input is synthesized and handed to handle_event() directly, the X server
+// runs the resulting requests and XSync() marks their completion
 
-	client_t *c = workspaces[workspace];
-	while( c->next->next )
-		c = c->next;
+int benchmark_display()
+{
+	char name[32];
+	pid_t xvfb = benchmark_xvfb( name, sizeof( name ) );
+	Display *c;
+	Window windows[BENCHMARK_WINDOWS];
+	histogram_t h;
+	XEvent e;
+
+	if( xvfb < 0 || !( display = XOpenDisplay( name ) ) || !( c = XOpenDisplay( name ) ) )
+	{
+		puts( "# no Xvfb, skipping end-to-end benchmarks" );
 
-	client_t *head = c->next;
-	c->next = NULL;	
-	head->next = workspaces[workspace];
-	workspaces[workspace] = head;
+		if( xvfb > 0 )
+		{
+			kill( xvfb, SIGTERM );
+			waitpid( xvfb, NULL, 0 );
+		}
 
-	window_current( workspaces[workspace]->window );
-}
+		return 0;
+	}
 
+	// Startup to ready with BENCHMARK_ADOPT windows already mapped, then
+	// drop them so the rest starts from an empty workspace
+	static Window adopt[BENCHMARK_ADOPT];
 
-void window_snap( int xf, int yf, int *x, int *y, int *w, int *h )
-{
-	if( xf )
+	for( int i = 0; i < BENCHMARK_ADOPT; i++ )
 	{
-	#ifdef GAPS
-		*w = ( sw / 2 ) - ( GAP_PIXELS * 3.0 / 2.0 );
-		*x = ( xf > 0 ) ? ( sw / 2 + GAP_PIXELS / 2.0 ) : GAP_PIXELS;
-	#else
-		*w = sw / 2;
-		*x = ( xf > 0 ) ? sw / 2 : 0;
-	#endif
-	}		
-	else
-	{
-	#ifdef GAPS
-		*w = sw - GAP_PIXELS * 2.0;
-		*x = GAP_PIXELS;
-	#else
-		*w = sw;
-		*x = 0;
-	#endif
+		adopt[i] = XCreateSimpleWindow( c, DefaultRootWindow( c ), i, i, 100, 100, 0, 0, 0 );
+		XMapWindow( c, adopt[i] );
 	}
 
-	if( yf )
-	{
-	#ifdef GAPS
-		*h = ( sh / 2 ) - ( GAP_PIXELS * 3.0 / 2.0 );
-		*y = ( yf > 0 ) ? ( sh / 2 + GAP_PIXELS / 2.0 ) : GAP_PIXELS;
-	#else
-		*h = sh / 2;
-		*y = ( yf > 0 ) ? sh / 2 : 0;
-	#endif
-	}
-	else
-	{
-	#ifdef GAPS
-		*h = sh - GAP_PIXELS * 2.0;
-		*y = GAP_PIXELS;
-	#else
-		*h = sh;
-		*y = 0;
-	#endif
-	}
-}
+	XSync( c, False );
 
+	uint64_t ready = monotonic();
+	setup();
+	XSync( display, False );
+	ready = monotonic() - ready;
 
-// 0 - Right
-// 1 - Up
-// 2 - Left
-// 3 - Down
+	printf( "name=startup windows=%d adopted=%u time=%llu\n", 
+	        BENCHMARK_ADOPT, client_count, ( unsigned long long ) ready );
 
-void window_push( argument_t const a )
-{
-	if( !workspaces[workspace] )
-		return;
+	// Floating while they go, sparing a relayout of the rest for each
+	layout_t layout = layouts[workspace];
+	layouts[workspace] = LAYOUT_FLOATING;
 
-	int x, y, w, h, xf, yf;	
-	window_size( workspaces[workspace]->window, &x, &y, &w, &h );
+	for( int i = 0; i < BENCHMARK_ADOPT; i++ )
+	{
+		window_delete( adopt[i] );
+		XDestroyWindow( c, adopt[i] );
+	}
 
-	if( x < ( sw / 2 ) && w < ( sw / 2 ) )      xf = -1;
-	else if( x > ( sw / 2 ) && w < ( sw / 2 ) ) xf = 1;
-	else                                        xf = 0;
+	layouts[workspace] = layout;
 
-	if( y < ( sh / 2 ) && h < ( sh / 2 ) )      yf = -1;
-	else if( y > ( sh / 2 ) && h < ( sh / 2 ) ) yf = 1;
-	else                                        yf = 0;
+	XSync( c, False );
+	XSync( display, False );
 
-	fprintf( stderr, "xf: %d\nyf: %d\n\n", xf, yf );
-	
-	if( ( xf == 1 && a.x == 0 ) || ( xf == -1 && a.x == 2 ) ||
-	    ( yf == 1 && a.x == 3 ) || ( yf == -1 && a.x == 1 ) )
-		return;
+	// MapRequest to a focused, fullscreen window
+	memset( &h, 0, sizeof( h ) );
 
-	
-	// LEFT / H
-	if( a.x == 2 )
+	for( int i = 0; i < BENCHMARK_WINDOWS; i++ )
 	{
-		fputs( "2\n", stderr );
-		if( xf == 1 )
-			xf = 0;
+		windows[i] = XCreateWindow( 
+			c, DefaultRootWindow( c ), 0, 0, 100, 100, 0, 
+			CopyFromParent, InputOutput, CopyFromParent, CWEventMask,
+			&(XSetWindowAttributes) { .event_mask = StructureNotifyMask | FocusChangeMask }
+		);
+		XSync( c, False );
 
-		else
-			xf = -1;
-	}
-	// RIGHT / L
-	else if( a.x == 0 )
-	{
-		fputs( "0\n", stderr );
-		if( xf == -1 )
-			xf = 0;		
+		uint64_t t = monotonic();
+		XMapWindow( c, windows[i] );
+		XFlush( c );
 
-		else
-			xf = 1;
+		if( benchmark_wait( c, windows[i], ConfigureNotify ) )
+			break;
+
+		histogram_add( &h, monotonic() - t );
 	}
-	// UP / K
-	else if( a.x == 1 )
+
+	benchmark_report( "map_request", &h );
+
+	// A tiled window asking to resize itself, answered without a configure
+	memset( &h, 0, sizeof( h ) );
+	uint64_t refused = configures_refused;
+
+	for( int i = 0; i < BENCHMARK_WINDOWS; i++ )
 	{
-		fputs( "1\n", stderr );
-		if( yf == 1 )
-			yf = 0;
+		uint64_t t = monotonic();
+		XResizeWindow( c, windows[i], 200 + i, 100 + i );
+		XFlush( c );
 
-		else
-			yf = -1;
+		if( benchmark_wait( c, windows[i], ConfigureNotify ) )
+			break;
+
+		histogram_add( &h, monotonic() - t );
 	}
-	// DOWN / J
-	else if( a.x == 3 )
-	{
-		fputs( "3\n", stderr );
-		if( yf == -1 )
-			yf = 0;
 
-		else
-			yf = 1;
+	benchmark_report( "configure_request", &h );
+	printf( "name=configure_refused count=%llu\n", 
+	        ( unsigned long long ) ( configures_refused - refused ) );
+
+	// Workspace switches away from and back to BENCHMARK_WINDOWS windows
+	memset( &h, 0, sizeof( h ) );
+
+	for( int i = 0; i < BENCHMARK_REPEAT; i++ )
+	{
+		uint64_t t = monotonic();
+		to_workspace( ( argument_t ) { .x = i % 2 ? 0 : 1 } );
+		batch_flush( 0 );
+		XSync( display, False );
+		histogram_add( &h, monotonic() - t );
 	}
 
-	fprintf( stderr, "xf: %d\nyf: %d\n\n", xf, yf );
-	fprintf( stderr, "x: %d\ny: %d\nw: %d\nh: %d\n\n", x, y, w, h );
+	benchmark_report( "to_workspace", &h );
 
-	window_snap( xf, yf, &x, &y, &w, &h );
+	// Drags of the current window, counting the configures that reach it
+	uint64_t t = monotonic();
+	uint32_t configures = 0;
 
-	fprintf( stderr, "x: %d\ny: %d\nw: %d\nh: %d\n\n", x, y, w, h );
+	for( int i = 0; i < BENCHMARK_REPEAT; i++ )
+	{
+		e = ( XEvent ) { .xbutton = { 
+			.type = ButtonPress, .subwindow = workspaces[workspace]->window, 
+			.button = 1, .x_root = sw / 2, .y_root = sh / 2, .time = i * 10000 
+		} };
+		handle_event( &e );
 
-    XMoveResizeWindow(
-		display, 
-		workspaces[workspace]->window,
-        x,
-        y,
-        w,
-        h
-	);
-}
+		for( int j = 1; j <= BENCHMARK_MOTIONS; j++ )
+		{
+			e = ( XEvent ) { .xmotion = { 
+				.type = MotionNotify, .x_root = sw / 2 + j % 200, .y_root = sh / 2, 
+				.time = i * 10000 + j
+			} };
+			handle_event( &e );
+		}
 
+		e.type = ButtonRelease;
+		handle_event( &e );
+		batch_flush( 0 );
+	}
 
-// window_to_workspace()
-//
-// Move the window to the given workpace
-//
-// a.x - The workspace to move the current window to
+	XSync( display, False );
+	t = monotonic() - t;
 
-void window_to_workspace( argument_t const a ) 
-{
-	#ifdef DEBUG
-		fputs( "WINDOW TO WORKSPACE\n", stderr );
-	#endif
+	while( XPending( c ) )
+		if( !XNextEvent( c, &e ) && e.type == ConfigureNotify )
+			configures++;
 
-	if( !workspaces[workspace] || a.x == workspace) 
-		return;
+	printf( 
+		"name=drag count=%d motions=%d configures=%u rate=%.0f\n", 
+		BENCHMARK_REPEAT, BENCHMARK_REPEAT * BENCHMARK_MOTIONS, configures,
+		BENCHMARK_REPEAT * BENCHMARK_MOTIONS / ( t / 1e9 )
+	);
 
-	client_t *c = workspaces[workspace];
-	workspaces[workspace] = c->next;
+	// KeyPress to the end of the bound action, switching workspaces
+	memset( &h, 0, sizeof( h ) );
+
+	for( int i = 0; i < BENCHMARK_REPEAT; i++ )
+	{
+		e = ( XEvent ) { .xkey = { 
+			.type = KeyPress, .root = root, .state = config->mod, 
+			.keycode = XKeysymToKeycode( display, i % 2 ? XK_1 : XK_2 ) 
+		} };
+
+		uint64_t t = monotonic();
+		handle_event( &e );
+		batch_flush( 0 );
+		XSync( display, False );
+		histogram_add( &h, monotonic() - t );
+	}
 
-	c->next = workspaces[a.x];
-	workspaces[a.x] = c;
+	benchmark_report( "key", &h );
 
-	XUnmapWindow(display, c->window);
+	XCloseDisplay( c );
+	XCloseDisplay( display );
+	kill( xvfb, SIGTERM );
+	waitpid( xvfb, NULL, 0 );
 
-	if( workspaces[workspace] )
-		window_current( workspaces[workspace]->window );
+	return 0;
 }
 
 
-// to_workspace()
+// benchmark_xvfb()
 //
-// Move to the given workpace
+// Start Xvfb on the first free display, waiting until it accepts connections
 //
-// a.x - The workspace to move to
+// name   - Set to the display name
+// length - The size of name
 
-void to_workspace( argument_t const a )
+pid_t benchmark_xvfb( char *name, size_t length )
 {
-	#ifdef DEBUG
-		fputs( "TO WORKSPACE\n", stderr );
-	#endif
+	char fd[16], number[16] = { 0 };
+	int fds[2];
 
-    if (a.x == workspace)
-		return;
+	if( pipe( fds ) )
+		return -1;
 
-    client_t *c = workspaces[workspace];
+	pid_t pid = fork();
 
-	while( c )
+	if( pid == 0 )
 	{
-		XUnmapWindow(display, c->window);
-		c = c->next;
+		close( fds[0] );
+		snprintf( fd, sizeof( fd ), "%d", fds[1] );
+		execlp( 
+			"Xvfb", "Xvfb", "-displayfd", fd, "-screen", "0", "1920x1080x24", 
+			"-nolisten", "tcp", NULL 
+		);
+		_exit( 127 );
 	}
 
-	workspace = a.x;
-	c = workspaces[workspace];
+	close( fds[1] );
+
+	// Xvfb writes its display number once ready, or closes the pipe on exit
+	ssize_t n = pid > 0 ? read( fds[0], number, sizeof( number ) - 1 ) : -1;
+	close( fds[0] );
 
-	while( c )
+	if( n <= 0 )
 	{
-		XMapWindow(display, c->window);
-		c = c->next;
+		if( pid > 0 )
+			waitpid( pid, NULL, 0 );
+
+		return -1;
 	}
 
-    if( workspaces[workspace] ) 
-		window_current( workspaces[workspace]->window ); 
-} 
+	snprintf( name, length, ":%d", atoi( number ) );
+	return pid;
+}
 
 
-// run()
+// benchmark_wait()
 //
-// Run the given program
+// Handle the window manager's events until the synthetic client receives an
+// event of the given type for the given window. Gives up after a second of
+// silence
 //
-// a.p - A pointer to the array of command strings
+// c    - The synthetic client's display
+// w    - The window
+// type - The event type
 
-void run( argument_t const a )
+int benchmark_wait( Display *c, Window w, int type )
 {
-	#ifdef DEBUG
-		fputs( "RUN\n", stderr );
-	#endif
+	struct pollfd fds[] = { 
+		{ .fd = ConnectionNumber( display ), .events = POLLIN }, 
+		{ .fd = ConnectionNumber( c ),       .events = POLLIN } 
+	};
+	XEvent e;
 
-	if( fork() ) 
-		return;
+	for( ;; )
+	{
+		while( XPending( display ) )
+		{
+			XNextEvent( display, &e );
+			handle_event( &e );
+		}
 
-    if( display )
-		close( ConnectionNumber( display ) );
+		batch_flush( 0 );
 
-	if ( errno == EAGAIN )
-		fprintf( stderr, "%s\n", "EAGAIN" );
-	if ( errno == ENOMEM )
-		fprintf( stderr, "%s\n", "ENOMEM" );
-	if ( errno == ENOSYS )
-		fprintf( stderr, "%s\n", "ENOSYS" );
+		while( XPending( c ) )
+		{
+			XNextEvent( c, &e );
 
-    setsid();
+			if( e.type == type && e.xany.window == w )
+				return 0;
+		}
 
-    execvp( ( char * )( ( char ** ) a.p )[0], ( char ** ) a.p );
+		if( poll( fds, LENGTH( fds ), 1000 ) <= 0 )
+			return 1;
+	}
 }
 
 
-// quit()
+// benchmark_report()
 //
-// Quit the window manager
+// Print the percentiles of a histogram
 //
-// a - Unused parameter
+// name - The benchmark
+// h    - The histogram
 
-void quit( argument_t const a )
+void benchmark_report( char const *name, histogram_t const *h )
 {
-	loop = 0;
+	printf( 
+		"name=%s count=%llu p50=%llu p90=%llu p99=%llu max=%llu\n",
+		name,
+		( unsigned long long ) h->count,
+		( unsigned long long ) histogram_percentile( h, 0.5 ),
+		( unsigned long long ) histogram_percentile( h, 0.9 ),
+		( unsigned long long ) histogram_percentile( h, 0.99 ),
+		( unsigned long long ) h->max
+	);
 }
 
+#endif // BENCHMARK
 
-// grab_input()
-//
-// Determine which keys to send events for
+
+// setup()
 //
-// d - The indicated display
-// root - The root window 
+// Take over the opened display: grab input and redirect the root's children
 
-void grab_input()
-{	
-    uint32_t i, j;
-	uint32_t null_modifiers[] = { 
-		0, 
-		LockMask, 
-		NumLockMask, 
-		NumLockMask|LockMask
-	};
+void setup()
+{
+	#ifdef DEBUG
+		uint64_t start = monotonic();
+	#endif
 
-    XModifierKeymap *modmap = XGetModifierMapping( display );
+#ifdef XCB
+	connection = XGetXCBConnection( display );
+#endif
 
-	// NumLock
-    for( i = 0; i < 8; i++ )
-        for( j = 0; j < modmap->max_keypermod; j++ )
-            if( modmap->modifiermap[i * modmap->max_keypermod + j] == 
-                 XKeysymToKeycode( display, 0xff7f ) )
-                NumLockMask = (1 << i);
+    XSetErrorHandler(xerror);
 
-	// Keys
-    for( i = 0; i < LENGTH(KEYS); i++ )
-        for( j = 0; j < LENGTH( null_modifiers ); j++ )
-            XGrabKey(
-				display, 
-				XKeysymToKeycode( display, KEYS[i].key ), 
-				KEYS[i].mod | null_modifiers[j], 
-				root,    
-				True, 
-				GrabModeAsync, 
-				GrabModeAsync
-			);
+	int screen = DefaultScreen( display );
+    root = RootWindow( display, screen );
+	sw = XDisplayWidth( display, screen );
+	sh = XDisplayHeight( display, screen );
 
-	// Buttons
-    for( i = 1; i < 4; i += 1 )
-        for( j = 0; j < LENGTH( null_modifiers); j++ )
-            XGrabButton(
-				display, 
-				i, 
-				MOD | null_modifiers[j], 
-				root, 
-				True,
-                ButtonPressMask|ButtonReleaseMask|PointerMotionMask,
-                GrabModeAsync, 
-				GrabModeAsync, 
-				0, 
-				0
-			);
+	for( int i = 0; i < LENGTH( layouts ); i++ )
+		layouts[i] = LAYOUT;
 
-    XFreeModifiermap(modmap);
-}
+	config_init( &defaults );
+	config_finish( &defaults );
+	config = &defaults;
 
+#ifdef CONFIG
+	snprintf( config_path, sizeof( config_path ), "%s/%s", getenv( "HOME" ) ?: ".", CONFIG );
 
-static int xerror()
-{ 
-	return 0; 
-}
+	config_t *c = config_read();
 
+	if( c )
+		config = c;
+#endif
 
-int main()
-{
-    XWindowAttributes attr;
-    XEvent ev;
+	snapshot_t snapshot;
+	int snapshot_fd = snapshot_open( &snapshot );
 
-    if( !( display = XOpenDisplay( 0x0 ) ) ) 
-		return 1;
-    
-    signal(SIGCHLD, SIG_IGN);
-    XSetErrorHandler(xerror);
+#ifdef CONTAINERS
+	// Containers redirect their children's requests just as the root does,
+	// after a restart they are the ones the old instance left in place
+	for( int i = 0; i < LENGTH( containers ); i++ )
+		containers[i] = snapshot_fd >= 0 ? snapshot.containers[i] : XCreateWindow( 
+			display, 
+			root, 
+			0, 
+			0, 
+			sw, 
+			sh, 
+			0, 
+			CopyFromParent, 
+			InputOutput, 
+			CopyFromParent,
+			CWOverrideRedirect | CWBackPixmap | CWEventMask,
+			&(XSetWindowAttributes) {
+				.override_redirect = True,
+				.background_pixmap = ParentRelative,
+				.event_mask        = SubstructureRedirectMask
+			}
+		);
+#endif
 
-	int screen = DefaultScreen( display );
-    root = RootWindow( display, screen );
-	sw = XDisplayWidth( display, screen );
-	sh = XDisplayHeight( display, screen );
+#ifdef RANDR
+	if( XRRQueryExtension( display, &randr_event, &(int){0} ) )
+		XRRSelectInput( display, root, RRScreenChangeNotifyMask );
+	else
+		randr_event = -RRScreenChangeNotify - 1; // Matches no event type
+#endif
+
+	output_update();
+	ewmh_setup();
+
+#ifdef OVERVIEW
+	// Automatic redirection leaves painting the screen to the server, the
+	// window contents only become readable while they are shown
+	if( XCompositeQueryExtension( display, &(int){0}, &(int){0} ) && 
+	    XDamageQueryExtension( display, &damage_event, &(int){0} ) )
+		XCompositeRedirectSubwindows( display, root, CompositeRedirectAutomatic );
+	else
+		damage_event = -XDamageNotify - 1; // Matches no event type
+#endif
+
+#ifdef CONTAINERS
+	if( snapshot_fd < 0 )
+		for( int i = 0; i < output_count; i++ )
+			XMapWindow( display, containers[outputs[i].workspace] );
+#endif
 
 	grab_input();
 
+#ifdef OUTLINE
+	outline_setup();
+#endif
+
 /*
     XGrabButton(dpy, 1, Mod1Mask, root, True, ButtonPressMask, GrabModeAsync,
             GrabModeAsync, None, None);
@@ -1026,10 +7538,40 @@ int main()
             GrabModeAsync, None, None);
 */
 
+	// Grabbed so that no window maps between the redirect and the scan
+	XGrabServer( display );
 	XSelectInput( display, root, SubstructureRedirectMask );
-    XDefineCursor( display, root, XCreateFontCursor( display, 68 ) );
 
-	loop = 1;
-	while( loop && !XNextEvent( display, &ev ) )
-		handle_event( &ev );
+	if( snapshot_fd >= 0 )
+		snapshot_restore( snapshot_fd, &snapshot );
+
+	window_adopt();
+	batch_flush( 0 );
+	XUngrabServer( display );
+
+	// The root holds on to the cursor, none is left to free on restart
+	Cursor cursor = XCreateFontCursor( display, 68 );
+	XDefineCursor( display, root, cursor );
+	XFreeCursor( display, cursor );
+
+	#ifdef DEBUG
+		XSync( display, False );
+		fprintf( stderr, "READY %.3f ms\n", ( monotonic() - start ) / 1e6 );
+	#endif
+}
+
+
+int main( int argc, char **argv )
+{
+	arguments = argv;
+
+#ifdef BENCHMARK
+	return benchmark();
+#endif
+
+    if( !( display = XOpenDisplay( 0x0 ) ) ) 
+		return 1;
+    
+	setup();
+	event_loop();
 }